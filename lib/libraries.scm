@@ -89,6 +89,7 @@
      #;(vicare language-extensions tags)
 
      (vicare build-tools automake)
+     (vicare build-tools parallel-compile)
 
      (vicare checks)
 
@@ -132,9 +133,12 @@
      (vicare containers one-dimension-cc)
      (vicare containers bytevectors u8)
      (vicare containers bytevectors s8)
+     (vicare containers bytevectors simd)
+     (vicare containers bytevectors views)
      (vicare containers arrays)
      (vicare containers stacks)
      (vicare containers queues)
+     (vicare containers timer-wheels)
 
      (vicare parser-tools silex lexer)
      (vicare parser-tools silex)
@@ -173,7 +177,8 @@
      (vicare gcc))
 
     ((WANT_POSIX WANT_LINUX)
-     (vicare linux))
+     (vicare linux)
+     (vicare linux io-engine))
 
     ((WANT_READLINE)
      (vicare readline))
@@ -83,6 +83,7 @@
     ((define-inline)			define-inline-macro)
     ((define-constant)			define-constant-macro)
     ((define-inline-constant)		define-inline-constant-macro)
+    ((define-constant-at-build)		define-constant-at-build-macro)
     ((define-values)			define-values-macro)
     ((define-constant-values)		define-constant-values-macro)
     ((receive)				receive-macro)
@@ -4793,7 +4794,7 @@
   #| end of module: XOR-MACRO |# )
 
 
-;;;; module non-core-macro-transformer: DEFINE-INLINE, DEFINE-CONSTANT
+;;;; module non-core-macro-transformer: DEFINE-INLINE, DEFINE-CONSTANT, DEFINE-CONSTANT-AT-BUILD
 
 (define (define-constant-macro expr-stx)
   ;;Transformer function used to  expand Vicare's DEFINE-CONSTANT macros
@@ -4838,6 +4839,36 @@
 		#`(quote #,const))))))))
     ))
 
+(define (define-constant-at-build-macro expr-stx)
+  ;;Transformer function used to expand Vicare's DEFINE-CONSTANT-AT-BUILD macros from
+  ;;the top-level built in environment.  Expand the contents of EXPR-STX; return a
+  ;;syntax object that must be further expanded.
+  ;;
+  ;;The expression is evaluated once at expand time, like for DEFINE-INLINE-CONSTANT;
+  ;;its result is referenced only by  the definition of the ghost variable, so the
+  ;;invoke code holds a single quoted  constant: when the library is compiled, the
+  ;;value is serialised in the FASL file and loading it does not evaluate ?EXPR.
+  ;;
+  (syntax-match expr-stx (brace)
+    ((_ (brace ?name ?tag) ?expr)
+     (and (identifier? ?name)
+	  (tag-identifier? ?tag))
+     (bless
+      `(begin
+	 (define-inline-constant const ,?expr)
+	 (define (brace ghost ,?tag) const)
+	 (define-syntax ,?name
+	   (identifier-syntax ghost)))))
+    ((_ ?name ?expr)
+     (identifier? ?name)
+     (bless
+      `(begin
+	 (define-inline-constant const ,?expr)
+	 (define ghost const)
+	 (define-syntax ,?name
+	   (identifier-syntax ghost)))))
+    ))
+
 (define (define-inline-macro expr-stx)
   ;;Transformer function  used to  expand Vicare's  DEFINE-INLINE macros
   ;;from the  top-level built  in environment.   Expand the  contents of
@@ -24,6 +24,7 @@
 #include "internals.h"
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <setjmp.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -42,6 +43,14 @@ typedef struct {
   char*		memp;
   char*		memq;
 
+  /* When the  boot image is a  compressed container: ZMEMP points  to the
+     next block header in the mapped file and ZMEMQ is the one-off end
+     pointer; MEMP and MEMQ delimit the current decompressed block, which
+     is  stored  in  the  buffer  at  MEMBASE.   Otherwise  ZMEMP  is
+     NULL. */
+  uint8_t *	zmemp;
+  uint8_t *	zmemq;
+
   /* These  are the  "Allocation  Pointer" and  "End  Pointer" for  code
      objects  allocation.  See  the  function "alloc_code_object()"  for
      details  about   how  code   objects  from   the  boot   image  are
@@ -70,6 +79,16 @@ static ikptr	do_read (ikpcb* pcb, fasl_port* p);
 static ikptr	alloc_code_object (ik_ulong scheme_object_size, ikpcb* pcb, fasl_port* p);
 static char	fasl_read_byte (fasl_port* p);
 static void	fasl_read_buf (fasl_port* p, void* buf, int n);
+static int	fasl_next_block (fasl_port* p);
+static uint32_t	ik_fasl_u32_ref (const uint8_t * p);
+static long	fasl_decompress (const uint8_t * src, long src_len, uint8_t * dst, long dst_len);
+
+/* Maximum number of  octets in a block of  compressed FASL containers.
+   It is also the size of the window of back references. */
+#define FASL_BLOCK_SIZE		65536
+
+/* Number of octets in the header of a block of compressed FASL data. */
+#define FASL_BLOCK_HEADER_SIZE	8
 
 
 void
@@ -113,13 +132,30 @@ ik_fasl_load (ikpcb* pcb, char* fasl_file)
     p.membase		= mem;			/* base of the input buffer */
     p.memp		= mem;			/* pointer to the next byte to read */
     p.memq		= mem + filesize;	/* one-off end pointer */
+    p.zmemp		= NULL;
+    p.zmemq		= NULL;
     p.marks		= 0;
     p.marks_size	= 0;
   }
 
+  /* If the boot image is  a compressed container: the blocks are
+     decompressed one at a time, when  the reader needs them, in a buffer
+     of FASL_BLOCK_SIZE octets; the whole decompressed image is never in
+     memory. */
+  if ((filesize >= IK_FASL_COMPRESSED_HEADER_LEN) &&
+      (0 == memcmp(mem, IK_FASL_COMPRESSED_HEADER, IK_FASL_COMPRESSED_HEADER_LEN))) {
+    if (DEBUG_FASL)
+      ik_debug_message("boot image is a compressed container");
+    p.zmemp		= (uint8_t *)mem + IK_FASL_COMPRESSED_HEADER_LEN;
+    p.zmemq		= (uint8_t *)mem + filesize;
+    p.membase		= ik_malloc(FASL_BLOCK_SIZE);
+    p.memp		= p.membase;
+    p.memq		= p.membase;
+  }
+
   /* Read  all the  objects  from  the memory  mapped  buffer.  Run  the
      initialisation code. */
-  while (p.memp < p.memq) {
+  while ((p.memp < p.memq) || fasl_next_block(&p)) {
     ikptr	s_code;
     p.code_ap	= 0;
     p.code_ep	= 0;
@@ -142,10 +178,12 @@ ik_fasl_load (ikpcb* pcb, char* fasl_file)
     /* Check if we have reached the end  of the boot image file.  At the
        end: we unmap the mmap buffer used to read the file and close the
        file descriptor. */
-    if (p.memp == p.memq) {
+    if ((p.memp == p.memq) && (! fasl_next_block(&p))) {
       int	err;
       if (DEBUG_FASL)
 	ik_debug_message("finished reading all the boot image");
+      if (p.membase != mem)
+	ik_free(p.membase, FASL_BLOCK_SIZE);
       err = munmap(mem, mapsize);
       if (err)
         ik_abort("failed to unmap fasl file: %s", strerror(errno));
@@ -934,7 +972,7 @@ static char
 fasl_read_byte (fasl_port* p)
 {
   char	c = '\0';
-  if (p->memp < p->memq) {
+  if ((p->memp < p->memq) || fasl_next_block(p)) {
     c = *(p->memp);
     p->memp++;
   } else
@@ -961,11 +999,1344 @@ fasl_read_buf (fasl_port* p, void* buf, int n)
  *       most significant
  */
 {
-  if ((p->memp+n) <= p->memq) {
+  /* With a compressed  boot image the block may  end in the middle of
+     the requested octets. */
+  while ((p->memp+n) > p->memq) {
+    long	count = p->memq - p->memp;
+    memcpy(buf, p->memp, count);
+    buf     = (char *)buf + count;
+    n      -= count;
+    p->memp = p->memq;
+    if (! fasl_next_block(p))
+      ik_abort("%s: attempt to read objects from boot image file beyond EOF", __func__);
+  }
+  memcpy(buf, p->memp, n);
+  p->memp += n;
+}
+static int
+fasl_next_block (fasl_port* p)
+/* If the boot image is  a compressed container: make the next block of
+   data available  between MEMP and MEMQ  and return true; return false
+   at the end of the container or if the boot image is not compressed.
+   Stored blocks are read in place from the mapped file. */
+{
+  uint32_t	data_len, block_len;
+  if (NULL == p->zmemp)
+    return 0;
+  if ((p->zmemq - p->zmemp) < FASL_BLOCK_HEADER_SIZE)
+    ik_abort("%s: truncated compressed boot image", __func__);
+  data_len  = ik_fasl_u32_ref(p->zmemp);
+  block_len = ik_fasl_u32_ref(p->zmemp + 4);
+  p->zmemp += FASL_BLOCK_HEADER_SIZE;
+  if (0 == data_len) {
+    /* End of the container. */
+    if (p->zmemp != p->zmemq)
+      ik_abort("%s: trailing data after compressed boot image", __func__);
+    p->zmemp = NULL;
+    return 0;
+  }
+  if ((data_len > FASL_BLOCK_SIZE) || (block_len > data_len) || (block_len > (p->zmemq - p->zmemp)))
+    ik_abort("%s: corrupted compressed boot image", __func__);
+  if (block_len == data_len) {
+    p->memp = (char *)p->zmemp;
+    p->memq = (char *)p->zmemp + data_len;
+  } else {
+    if (data_len != fasl_decompress(p->zmemp, block_len, (uint8_t *)p->membase, data_len))
+      ik_abort("%s: corrupted compressed boot image", __func__);
+    p->memp = p->membase;
+    p->memq = p->membase + data_len;
+  }
+  p->zmemp += block_len;
+  return 1;
+}
+
+
+/** --------------------------------------------------------------------
+ ** Reading FASL objects at run time.
+ ** ----------------------------------------------------------------- */
+
+/* The boot image reader above aborts the process when it finds invalid
+   data, and it  supports only the object types needed  by the boot image.
+   The functions below  read FASL objects from the data  area of a Scheme
+   bytevector, for example the contents of a compiled library file; they
+   implement the same format as the Scheme reader in "ikarus.fasl.read.sls".
+
+   Some object types cannot  be built from C: R6RS record-type descriptors
+   and hashtables, which need Scheme procedures.  Before building anything
+   the object is scanned, without allocating: if it holds such types or it
+   is invalid, the Scheme reader reads  it; in turn the Scheme reader hands
+   every  code object back  to the C functions, sharing  its table of
+   marks.  So the expensive part of a library is always decoded here and
+   no object is decoded twice.  The only late failure is a structure type
+   not yet defined, see "rt_fasl_read_struct_type()".
+
+   Strings are not interned as the Scheme reader does with "intern-string":
+   the table of interned strings is a  Scheme hashtable, not accessible
+   from C.  When  compiling libraries the writer already merges equal string
+   constants in the same file; only the sharing with other files is lost.
+
+   All the  allocations are unsafe,  so no garbage collection  happens while
+   reading: the references held in C variables and in the table of marks
+   stay valid. */
+
+#define RT_FASL_INITIAL_MARKS	1024
+
+typedef struct {
+  ikptr		s_bv;		/* the bytevector being read */
+  uint8_t *	memp;		/* pointer to the next octet to read */
+  uint8_t *	memq;		/* one-off end pointer */
+  ikptr *	marks;		/* table of marked objects, or NULL */
+  long		marks_size;	/* number of slots in the table of marks */
+  int		frozen_marks;	/* true if no mark can be defined */
+  ikptr		s_lazy_template; /* closure template of lazy procedures */
+  ikptr		s_marks_holder;	/* vector receiving the table of marks, or 0 */
+  /* When true: "marks" is the data area of the Scheme vector used as table of
+     marks by the  Scheme reader; the indexes of the marks  defined here are
+     recorded in "defined", so that they can be undone if we give up. */
+  int		shared_marks;
+  uint32_t *	defined;
+  long		defined_count;
+  long		defined_size;
+  int		marks_too_small; /* true if a mark did not fit the shared table */
+  /* When not NULL: "rt_fasl_scan()" renumbers the references to marks, see
+     "rt_fasl_compact_lazy_marks()"; the old indexes are recorded in "defined". */
+  uint32_t *	remap;
+  uint32_t	remap_count;
+  int		remap_write;
+  /* The descriptors of the lazy procedures built while reading. */
+  ikptr *	lazy;
+  long		lazy_count;
+  long		lazy_size;
+  jmp_buf	failure;	/* where to jump to give up */
+} rt_fasl_port;
+
+/* Counters of the lazy procedures, see "ikrt_fasl_lazy_code_statistics()".
+   They only grow, except LAZY_RETAINED_BYTES which is decremented when a
+   code object is loaded; the garbage collector does not update them. */
+static long	lazy_procedures_count = 0;
+static long	lazy_deferred_bytes   = 0;
+static long	lazy_loaded_count     = 0;
+static long	lazy_loaded_bytes     = 0;
+static long	lazy_retained_bytes   = 0;
+
+static ikptr	rt_fasl_read (ikpcb * pcb, rt_fasl_port * p);
+
+static void
+rt_fasl_fail (rt_fasl_port * p)
+{
+  longjmp(p->failure, 1);
+}
+static uint8_t
+rt_fasl_read_byte (rt_fasl_port * p)
+{
+  if (p->memp < p->memq)
+    return *(p->memp++);
+  else {
+    rt_fasl_fail(p);
+    return 0;
+  }
+}
+static void
+rt_fasl_read_buf (rt_fasl_port * p, void * buf, long n)
+{
+  if ((0 <= n) && (n <= (p->memq - p->memp))) {
     memcpy(buf, p->memp, n);
     p->memp += n;
   } else
-    ik_abort("%s: attempt to read objects from boot image file beyond EOF", __func__);
+    rt_fasl_fail(p);
+}
+static long
+rt_fasl_read_long (rt_fasl_port * p)
+/* Read a machine word serialised in host byte order. */
+{
+  long	n = 0;
+  rt_fasl_read_buf(p, &n, sizeof(long));
+  return n;
+}
+static long
+rt_fasl_read_length (rt_fasl_port * p)
+/* Read a machine word representing the number of items in an object; the
+   number must be non-negative and not  bigger than the number of octets
+   left, which is a cheap upper bound protecting the allocations. */
+{
+  long	n = rt_fasl_read_long(p);
+  if ((n < 0) || (n > (p->memq - p->memp)))
+    rt_fasl_fail(p);
+  return n;
+}
+static void
+rt_fasl_push_index (rt_fasl_port * p, uint32_t idx)
+{
+  if (p->defined_count == p->defined_size) {
+    long	size    = p->defined_size? 2 * p->defined_size : 64;
+    uint32_t *	defined = ik_malloc(size * sizeof(uint32_t));
+    if (p->defined) {
+      memcpy(defined, p->defined, p->defined_count * sizeof(uint32_t));
+      ik_free(p->defined, p->defined_size * sizeof(uint32_t));
+    }
+    p->defined      = defined;
+    p->defined_size = size;
+  }
+  p->defined[p->defined_count++] = idx;
+}
+static void
+rt_fasl_push_lazy (rt_fasl_port * p, ikptr s_descr)
+{
+  if (p->lazy_count == p->lazy_size) {
+    long	size = p->lazy_size? 2 * p->lazy_size : 64;
+    ikptr *	lazy = ik_malloc(size * sizeof(ikptr));
+    if (p->lazy) {
+      memcpy(lazy, p->lazy, p->lazy_count * sizeof(ikptr));
+      ik_free(p->lazy, p->lazy_size * sizeof(ikptr));
+    }
+    p->lazy      = lazy;
+    p->lazy_size = size;
+  }
+  p->lazy[p->lazy_count++] = s_descr;
+}
+static void
+rt_fasl_put_shared_mark (rt_fasl_port * p, uint32_t idx, ikptr s_obj)
+{
+  if (idx >= p->marks_size) {
+    p->marks_too_small = 1;
+    rt_fasl_fail(p);
+  }
+  if (IK_FALSE_OBJECT != p->marks[idx])
+    rt_fasl_fail(p);
+  rt_fasl_push_index(p, idx);
+  p->marks[idx] = s_obj;
+}
+static void
+rt_fasl_put_mark (rt_fasl_port * p, uint32_t idx, ikptr s_obj)
+{
+  if (idx) {
+    if (p->frozen_marks)
+      rt_fasl_fail(p);
+    if (p->shared_marks) {
+      rt_fasl_put_shared_mark(p, idx, s_obj);
+      return;
+    }
+    if (idx >= p->marks_size) {
+      long	size  = p->marks_size? p->marks_size : RT_FASL_INITIAL_MARKS;
+      ikptr *	marks;
+      while (idx >= size)
+	size *= 2;
+      marks = ik_malloc(size * sizeof(ikptr));
+      memset(marks, 0, size * sizeof(ikptr));
+      if (p->marks) {
+	memcpy(marks, p->marks, p->marks_size * sizeof(ikptr));
+	ik_free(p->marks, p->marks_size * sizeof(ikptr));
+      }
+      p->marks      = marks;
+      p->marks_size = size;
+    }
+    if (p->marks[idx])
+      rt_fasl_fail(p);
+    p->marks[idx] = s_obj;
+  }
+}
+static ikptr
+rt_fasl_read_string (ikpcb * pcb, rt_fasl_port * p, int ascii)
+{
+  long	len  = rt_fasl_read_length(p);
+  ikptr	s_str = ik_unsafe_alloc(pcb, IK_ALIGN(len * IK_STRING_CHAR_SIZE + disp_string_data)) | string_tag;
+  long	i;
+  IK_REF(s_str, off_string_length) = IK_FIX(len);
+  for (i=0; i<len; ++i) {
+    if (ascii)
+      IK_CHAR32(s_str, i) = IK_CHAR32_FROM_INTEGER(rt_fasl_read_byte(p));
+    else {
+      uint32_t	ch = 0;
+      rt_fasl_read_buf(p, &ch, sizeof(uint32_t));
+      IK_CHAR32(s_str, i) = IK_CHAR32_FROM_INTEGER(ch);
+    }
+  }
+  return s_str;
+}
+static ikptr
+rt_fasl_read_code (ikpcb * pcb, rt_fasl_port * p, uint32_t mark, uint32_t closure_mark)
+/* Read the  fields of a code  object after the "x" header; the layout is
+   the one read by "do_read()" for the boot image.  Like "ikrt_make_code()"
+   every code object is allocated in its own pages.
+
+   If  CLOSURE_MARK is not  zero: a closure with  no free variables is built
+   with the code and marked  with it, before reading the relocation vector
+   which may reference it. */
+{
+  long		code_size = rt_fasl_read_length(p);
+  ikptr		s_freevars;
+  ikptr		s_annotation;
+  ikptr		s_reloc_vec;
+  ikptr		p_code;
+  long		memreq;
+  rt_fasl_read_buf(p, &s_freevars, sizeof(ikptr));
+  if (! IK_IS_FIXNUM(s_freevars))
+    rt_fasl_fail(p);
+  s_annotation	= rt_fasl_read(pcb, p);
+  memreq	= IK_ALIGN_TO_NEXT_PAGE(disp_code_data + code_size);
+  p_code	= ik_mmap_code(memreq, 0, pcb);
+  bzero((char*)(long)p_code, memreq);
+  IK_REF(p_code, disp_code_tag)		= code_tag;
+  IK_REF(p_code, disp_code_code_size)	= IK_FIX(code_size);
+  IK_REF(p_code, disp_code_freevars)	= s_freevars;
+  IK_REF(p_code, disp_code_annotation)	= s_annotation;
+  rt_fasl_read_buf(p, (void*)(long)(p_code + disp_code_data), code_size);
+  rt_fasl_put_mark(p, mark, p_code | vector_tag);
+  if (closure_mark) {
+    ikptr	s_proc = ik_unsafe_alloc(pcb, IK_ALIGN(disp_closure_data)) | closure_tag;
+    IK_REF(s_proc, off_closure_code) = p_code + disp_code_data;
+    rt_fasl_put_mark(p, closure_mark, s_proc);
+  }
+  s_reloc_vec = rt_fasl_read(pcb, p);
+  if (! ik_is_vector(s_reloc_vec))
+    rt_fasl_fail(p);
+  IK_REF(p_code, disp_code_reloc_vector) = s_reloc_vec;
+  ik_relocate_code(p_code);
+  IK_SIGNAL_DIRT_IN_PAGE_OF_POINTER(pcb, p_code);
+  return p_code | vector_tag;
+}
+static ikptr
+rt_fasl_read_lazy_procedure (ikpcb * pcb, rt_fasl_port * p, uint32_t mark)
+/* Read the fields of a lazy procedure after the "z" header:
+
+     int	: number of the objects that follow
+     object ...	: shared objects referenced by the code object
+     int	: number of octets in the code object
+     octet ...	: the code object, serialised as "x"
+
+   The code object is not read: we build a stub closure whose code is the
+   one of the template  closure and whose single free variable references
+   the descriptor vector:
+
+     #(stub bytevector code-object-offset marks-holder)
+
+   on its first call the stub reads the code object and patches itself, see
+   "ikrt_fasl_read_lazy_code()".  The serialised code object is copied in a
+   bytevector of its own, so the stub does not keep alive the FASL data of
+   the whole library.  The marks holder is a vector of length 1 receiving
+   the table of marks at the end of the read: the code object can reference
+   the objects marked in the whole FASL object; then the table is reduced
+   to the referenced objects, see "rt_fasl_compact_lazy_marks()". */
+{
+  ikptr	s_descr;
+  ikptr	s_stub;
+  ikptr	s_code_bv;
+  long	count;
+  long	len;
+  /* The  code  object  of a lazy  procedure holds no marks definitions, so
+     there are no lazy procedures in it. */
+  if (p->frozen_marks || p->shared_marks ||
+      (IK_FIX(1) != IK_REF(IK_REF(p->s_lazy_template, off_closure_code) - off_code_data,
+			   off_code_freevars)))
+    rt_fasl_fail(p);
+  if (0 == p->s_marks_holder) {
+    p->s_marks_holder = ik_unsafe_alloc(pcb, IK_ALIGN(wordsize + disp_vector_data)) | vector_tag;
+    IK_REF(p->s_marks_holder, off_vector_length) = IK_FIX(1);
+    IK_ITEM(p->s_marks_holder, 0) = IK_FALSE_OBJECT;
+  }
+  s_descr = ik_unsafe_alloc(pcb, IK_ALIGN(4 * wordsize + disp_vector_data)) | vector_tag;
+  s_stub  = ik_unsafe_alloc(pcb, IK_ALIGN(disp_closure_data + wordsize)) | closure_tag;
+  IK_REF(s_descr, off_vector_length) = IK_FIX(4);
+  IK_ITEM(s_descr, 0) = s_stub;
+  IK_ITEM(s_descr, 1) = IK_FALSE_OBJECT;
+  IK_ITEM(s_descr, 2) = IK_FIX(0);
+  IK_ITEM(s_descr, 3) = p->s_marks_holder;
+  IK_REF(s_stub, off_closure_code) = IK_REF(p->s_lazy_template, off_closure_code);
+  IK_REF(s_stub, off_closure_data) = s_descr;
+  rt_fasl_put_mark(p, mark, s_stub);
+  for (count = rt_fasl_read_length(p); count; --count)
+    rt_fasl_read(pcb, p);
+  len       = rt_fasl_read_length(p);
+  s_code_bv = ik_unsafe_alloc(pcb, IK_ALIGN(len + disp_bytevector_data + 1)) | bytevector_tag;
+  IK_REF(s_code_bv, off_bytevector_length) = IK_FIX(len);
+  rt_fasl_read_buf(p, IK_BYTEVECTOR_DATA_VOIDP(s_code_bv), len);
+  IK_BYTEVECTOR_DATA_CHARP(s_code_bv)[len] = '\0';
+  IK_ITEM(s_descr, 1) = s_code_bv;
+  rt_fasl_push_lazy(p, s_descr);
+  ++lazy_procedures_count;
+  lazy_deferred_bytes += len;
+  return s_stub;
+}
+static ikptr
+rt_fasl_read_list (ikpcb * pcb, rt_fasl_port * p, long len, uint32_t mark)
+{
+  ikptr	s_list = ik_unsafe_alloc(pcb, IK_ALIGN(pair_size) * (len+1)) | pair_tag;
+  ikptr	s_pair = s_list;
+  long	i;
+  rt_fasl_put_mark(p, mark, s_list);
+  for (i=0; i<len; ++i) {
+    IK_REF(s_pair, off_car) = rt_fasl_read(pcb, p);
+    IK_REF(s_pair, off_cdr) = s_pair + IK_ALIGN(pair_size);
+    s_pair += IK_ALIGN(pair_size);
+  }
+  IK_REF(s_pair, off_car) = rt_fasl_read(pcb, p);
+  IK_REF(s_pair, off_cdr) = rt_fasl_read(pcb, p);
+  return s_list;
+}
+static int
+rt_fasl_same_strings (ikptr s_str1, ikptr s_str2)
+{
+  long	len = IK_STRING_LENGTH(s_str1);
+  long	i;
+  if (len != IK_STRING_LENGTH(s_str2))
+    return 0;
+  for (i=0; i<len; ++i)
+    if (IK_CHAR32(s_str1, i) != IK_CHAR32(s_str2, i))
+      return 0;
+  return 1;
+}
+static ikptr
+rt_fasl_read_struct_type (ikpcb * pcb, rt_fasl_port * p)
+/* Read the fields of  a struct-type descriptor after the "R" header.  We
+   only accept descriptors already bound  to their unique symbol, having
+   the same  name  and  number of fields: building a new one  requires the
+   default  struct printer, which lives in Scheme. */
+{
+  ikptr	s_name   = rt_fasl_read(pcb, p);
+  ikptr	s_symbol = rt_fasl_read(pcb, p);
+  long	count    = rt_fasl_read_length(p);
+  ikptr	s_std;
+  long	i;
+  for (i=0; i<count; ++i)
+    rt_fasl_read(pcb, p);
+  if (! (IK_IS_STRING(s_name) && ik_is_symbol(s_symbol)))
+    rt_fasl_fail(p);
+  s_std = IK_REF(s_symbol, off_symbol_record_value);
+  if ((vector_tag == (vector_mask & s_std)) &&
+      (pcb->base_rtd == IK_REF(s_std, off_rtd_rtd)) &&
+      (IK_FIX(count) == IK_REF(s_std, off_rtd_length)) &&
+      IK_IS_STRING(IK_REF(s_std, off_rtd_name)) &&
+      rt_fasl_same_strings(s_name, IK_REF(s_std, off_rtd_name)))
+    return s_std;
+  else {
+    rt_fasl_fail(p);
+    return IK_VOID_OBJECT;
+  }
+}
+static ikptr
+rt_fasl_read (ikpcb * pcb, rt_fasl_port * p)
+/* Read and return the next object. */
+{
+  uint32_t	mark = 0;
+  uint8_t	c    = rt_fasl_read_byte(p);
+  if ('>' == c) {
+    rt_fasl_read_buf(p, &mark, sizeof(uint32_t));
+    if (0 == mark)
+      rt_fasl_fail(p);
+    c = rt_fasl_read_byte(p);
+  }
+  switch (c) {
+  case 'I': {
+    ikptr	s_fx = 0;
+    rt_fasl_read_buf(p, &s_fx, sizeof(ikptr));
+    return s_fx;
+  }
+  case 'N':	return IK_NULL_OBJECT;
+  case 'T':	return IK_TRUE_OBJECT;
+  case 'F':	return IK_FALSE_OBJECT;
+  case 'E':	return IK_EOF_OBJECT;
+  case 'U':	return IK_VOID_OBJECT;
+  case 'c':	return IK_CHAR_FROM_INTEGER(rt_fasl_read_byte(p));
+  case 'C': {
+    uint32_t	ch = 0;
+    rt_fasl_read_buf(p, &ch, sizeof(uint32_t));
+    return IK_CHAR_FROM_INTEGER(ch);
+  }
+  case 'P': {
+    ikptr	s_pair = ik_unsafe_alloc(pcb, pair_size) | pair_tag;
+    rt_fasl_put_mark(p, mark, s_pair);
+    IK_REF(s_pair, off_car) = rt_fasl_read(pcb, p);
+    IK_REF(s_pair, off_cdr) = rt_fasl_read(pcb, p);
+    return s_pair;
+  }
+  case 'l':
+    return rt_fasl_read_list(pcb, p, rt_fasl_read_byte(p), mark);
+  case 'L':
+    return rt_fasl_read_list(pcb, p, rt_fasl_read_length(p), mark);
+  case 's':
+  case 'S': {
+    ikptr	s_str = rt_fasl_read_string(pcb, p, ('s' == c));
+    rt_fasl_put_mark(p, mark, s_str);
+    return s_str;
+  }
+  case 'M': {
+    ikptr	s_str = rt_fasl_read(pcb, p);
+    ikptr	s_sym;
+    if (! IK_IS_STRING(s_str))
+      rt_fasl_fail(p);
+    s_sym = ikrt_string_to_symbol(s_str, pcb);
+    rt_fasl_put_mark(p, mark, s_sym);
+    return s_sym;
+  }
+  case 'G': {
+    ikptr	s_pretty = rt_fasl_read(pcb, p);
+    ikptr	s_unique = rt_fasl_read(pcb, p);
+    ikptr	s_sym;
+    if (! (IK_IS_STRING(s_pretty) && IK_IS_STRING(s_unique)))
+      rt_fasl_fail(p);
+    s_sym = ikrt_strings_to_gensym(s_pretty, s_unique, pcb);
+    rt_fasl_put_mark(p, mark, s_sym);
+    return s_sym;
+  }
+  case 'V': {
+    long	len   = rt_fasl_read_length(p);
+    ikptr	s_vec = ik_unsafe_alloc(pcb, IK_ALIGN(len * wordsize + disp_vector_data)) | vector_tag;
+    long	i;
+    IK_REF(s_vec, off_vector_length) = IK_FIX(len);
+    /* Initialise the slots before marking: a reference to the mark may show
+       up while reading the items. */
+    for (i=0; i<len; ++i)
+      IK_ITEM(s_vec, i) = IK_FALSE_OBJECT;
+    rt_fasl_put_mark(p, mark, s_vec);
+    for (i=0; i<len; ++i)
+      IK_ITEM(s_vec, i) = rt_fasl_read(pcb, p);
+    return s_vec;
+  }
+  case 'v': {
+    long	len  = rt_fasl_read_length(p);
+    ikptr	s_bv = ik_unsafe_alloc(pcb, IK_ALIGN(len + disp_bytevector_data + 1)) | bytevector_tag;
+    IK_REF(s_bv, off_bytevector_length) = IK_FIX(len);
+    rt_fasl_read_buf(p, IK_BYTEVECTOR_DATA_VOIDP(s_bv), len);
+    IK_BYTEVECTOR_DATA_CHARP(s_bv)[len] = '\0';
+    rt_fasl_put_mark(p, mark, s_bv);
+    return s_bv;
+  }
+  case 'x':
+    return rt_fasl_read_code(pcb, p, mark, 0);
+  case 'z':
+    return rt_fasl_read_lazy_procedure(pcb, p, mark);
+  case 'Q': {
+    /* A closure  with no free  variables; the code object follows, possibly
+       marked or as reference to a mark. */
+    ikptr	s_proc = ik_unsafe_alloc(pcb, IK_ALIGN(disp_closure_data)) | closure_tag;
+    ikptr	s_code;
+    IK_REF(s_proc, off_closure_code) = 0;
+    rt_fasl_put_mark(p, mark, s_proc);
+    s_code = rt_fasl_read(pcb, p);
+    if (! IK_IS_CODE(s_code))
+      rt_fasl_fail(p);
+    IK_REF(s_proc, off_closure_code) = s_code + off_code_data;
+    return s_proc;
+  }
+  case '<': {
+    uint32_t	idx = 0;
+    rt_fasl_read_buf(p, &idx, sizeof(uint32_t));
+    /* Unused slots are NULL, or false in the vector of marks used for lazy
+       procedures. */
+    if ((0 == idx) || (idx >= p->marks_size) ||
+	(0 == p->marks[idx]) || (IK_FALSE_OBJECT == p->marks[idx]))
+      rt_fasl_fail(p);
+    return p->marks[idx];
+  }
+  case 'R': {
+    ikptr	s_std = rt_fasl_read_struct_type(pcb, p);
+    rt_fasl_put_mark(p, mark, s_std);
+    return s_std;
+  }
+  case '{': {
+    long	count  = rt_fasl_read_length(p);
+    ikptr	s_struct = ik_unsafe_alloc(pcb, IK_ALIGN((1 + count) * wordsize)) | vector_tag;
+    ikptr	s_std;
+    long	i;
+    for (i=0; i<count; ++i)
+      IK_FIELD(s_struct, i) = IK_FIX(0);
+    IK_REF(s_struct, off_record_rtd) = IK_FALSE_OBJECT;
+    rt_fasl_put_mark(p, mark, s_struct);
+    s_std = rt_fasl_read(pcb, p);
+    if (! ((vector_tag == (vector_mask & s_std)) &&
+	   (pcb->base_rtd == IK_REF(s_std, off_rtd_rtd)) &&
+	   (IK_FIX(count) == IK_REF(s_std, off_rtd_length))))
+      rt_fasl_fail(p);
+    IK_REF(s_struct, off_record_rtd) = s_std;
+    for (i=0; i<count; ++i)
+      IK_FIELD(s_struct, i) = rt_fasl_read(pcb, p);
+    return s_struct;
+  }
+  case 'f': {
+    ikptr	s_fl = ik_unsafe_alloc(pcb, flonum_size) | vector_tag;
+    IK_REF(s_fl, -vector_tag) = flonum_tag;
+    rt_fasl_read_buf(p, (void*)(long)(s_fl + disp_flonum_data - vector_tag), 8);
+    rt_fasl_put_mark(p, mark, s_fl);
+    return s_fl;
+  }
+  case 'b': {
+    long	count = rt_fasl_read_long(p);
+    long	sign  = 0;
+    long	nlimbs;
+    ikptr	s_bn;
+    if (count < 0) {
+      sign  = 1;
+      count = -count;
+    }
+    if ((0 == count) || (count & (wordsize - 1)) || (count > (p->memq - p->memp)))
+      rt_fasl_fail(p);
+    nlimbs = count / wordsize;
+    s_bn   = ik_unsafe_alloc(pcb, IK_ALIGN(count + disp_bignum_data)) | vector_tag;
+    IK_REF(s_bn, -vector_tag) = (ikptr)(bignum_tag | (sign << bignum_sign_shift) | (nlimbs << bignum_nlimbs_shift));
+    rt_fasl_read_buf(p, (void*)(long)(s_bn + off_bignum_data), count);
+    rt_fasl_put_mark(p, mark, s_bn);
+    return s_bn;
+  }
+  case 'r': {
+    /* The writer serialises normalised ratnums: denominator first. */
+    ikptr	s_den = rt_fasl_read(pcb, p);
+    ikptr	s_num = rt_fasl_read(pcb, p);
+    ikptr	s_rn  = ik_unsafe_alloc(pcb, ratnum_size) | vector_tag;
+    IK_REF(s_rn, off_ratnum_tag)	= ratnum_tag;
+    IK_REF(s_rn, off_ratnum_num)	= s_num;
+    IK_REF(s_rn, off_ratnum_den)	= s_den;
+    IK_REF(s_rn, off_ratnum_unused)	= IK_FIX(0);
+    rt_fasl_put_mark(p, mark, s_rn);
+    return s_rn;
+  }
+  case 'i': {
+    ikptr	s_real = rt_fasl_read(pcb, p);
+    ikptr	s_imag = rt_fasl_read(pcb, p);
+    ikptr	s_cn;
+    /* Like "make-rectangular": a cflonum only if both the parts are flonums. */
+    if ((vector_tag == IK_TAGOF(s_real)) && (flonum_tag == IK_REF(s_real, -vector_tag)) &&
+	(vector_tag == IK_TAGOF(s_imag)) && (flonum_tag == IK_REF(s_imag, -vector_tag))) {
+      s_cn = ik_unsafe_alloc(pcb, cflonum_size);
+      IK_REF(s_cn, 0) = cflonum_tag;
+      IK_REF(s_cn, disp_cflonum_real) = s_real;
+      IK_REF(s_cn, disp_cflonum_imag) = s_imag;
+    } else {
+      s_cn = ik_unsafe_alloc(pcb, compnum_size);
+      IK_REF(s_cn, 0) = compnum_tag;
+      IK_REF(s_cn, disp_compnum_real) = s_real;
+      IK_REF(s_cn, disp_compnum_imag) = s_imag;
+    }
+    s_cn |= vector_tag;
+    rt_fasl_put_mark(p, mark, s_cn);
+    return s_cn;
+  }
+  default:
+    /* Among the others: "W" R6RS record-type descriptors, "h" and "H"
+       hashtables, "O" not at the beginning of an object; they are rejected
+       by "rt_fasl_scan()" before we get here. */
+    rt_fasl_fail(p);
+    return IK_VOID_OBJECT;
+  }
+}
+static void
+rt_fasl_skip (rt_fasl_port * p, long n)
+{
+  if ((0 <= n) && (n <= (p->memq - p->memp)))
+    p->memp += n;
+  else
+    rt_fasl_fail(p);
+}
+static void
+rt_fasl_remap_mark (rt_fasl_port * p)
+/* Read  the index of a reference  to a mark and, in  the second pass,
+   overwrite it with the new index. */
+{
+  uint8_t *	q = p->memp;
+  uint32_t	idx;
+  rt_fasl_read_buf(p, &idx, sizeof(uint32_t));
+  if ((0 == idx) || (idx >= p->marks_size))
+    rt_fasl_fail(p);
+  if (0 == p->remap[idx]) {
+    if (p->remap_write)
+      rt_fasl_fail(p);
+    p->remap[idx] = ++p->remap_count;
+    rt_fasl_push_index(p, idx);
+  }
+  if (p->remap_write)
+    memcpy(q, &(p->remap[idx]), sizeof(uint32_t));
+}
+static void
+rt_fasl_scan (rt_fasl_port * p)
+/* Skip the next object, without allocating  anything; give up if it holds
+   an object type that  "rt_fasl_read()" cannot build or if it is invalid.
+   This must accept the same format of "rt_fasl_read()". */
+{
+  uint8_t	c = rt_fasl_read_byte(p);
+  if ('>' == c) {
+    if (p->remap)
+      rt_fasl_fail(p);
+    rt_fasl_skip(p, sizeof(uint32_t));
+    c = rt_fasl_read_byte(p);
+  }
+  switch (c) {
+  case 'N': case 'T': case 'F': case 'E': case 'U':
+    return;
+  case 'I':
+    rt_fasl_skip(p, sizeof(ikptr));
+    return;
+  case 'c':
+    rt_fasl_skip(p, 1);
+    return;
+  case 'C':
+    rt_fasl_skip(p, sizeof(uint32_t));
+    return;
+  case '<':
+    if (p->remap)
+      rt_fasl_remap_mark(p);
+    else
+      rt_fasl_skip(p, sizeof(uint32_t));
+    return;
+  case 'P':
+  case 'G':
+  case 'r':
+  case 'i':
+    rt_fasl_scan(p);
+    rt_fasl_scan(p);
+    return;
+  case 'M':
+  case 'Q':
+    rt_fasl_scan(p);
+    return;
+  case 'l':
+  case 'L': {
+    long	len = ('l' == c)? rt_fasl_read_byte(p) : rt_fasl_read_length(p);
+    for (len += 2; len; --len)
+      rt_fasl_scan(p);
+    return;
+  }
+  case 's':
+    rt_fasl_skip(p, rt_fasl_read_length(p));
+    return;
+  case 'S': {
+    long	len = rt_fasl_read_length(p);
+    if (len > ((p->memq - p->memp) / (long)sizeof(uint32_t)))
+      rt_fasl_fail(p);
+    rt_fasl_skip(p, len * sizeof(uint32_t));
+    return;
+  }
+  case 'V': {
+    long	len;
+    for (len = rt_fasl_read_length(p); len; --len)
+      rt_fasl_scan(p);
+    return;
+  }
+  case 'v':
+    rt_fasl_skip(p, rt_fasl_read_length(p));
+    return;
+  case 'x': {
+    long	code_size = rt_fasl_read_length(p);
+    rt_fasl_skip(p, sizeof(ikptr));
+    rt_fasl_scan(p);
+    rt_fasl_skip(p, code_size);
+    rt_fasl_scan(p);
+    return;
+  }
+  case 'z': {
+    long	count;
+    if (p->shared_marks)
+      rt_fasl_fail(p);
+    for (count = rt_fasl_read_length(p); count; --count)
+      rt_fasl_scan(p);
+    rt_fasl_skip(p, rt_fasl_read_length(p));
+    return;
+  }
+  case 'R': {
+    long	count;
+    rt_fasl_scan(p);
+    rt_fasl_scan(p);
+    for (count = rt_fasl_read_length(p); count; --count)
+      rt_fasl_scan(p);
+    return;
+  }
+  case '{': {
+    long	count = rt_fasl_read_length(p);
+    for (++count; count; --count)
+      rt_fasl_scan(p);
+    return;
+  }
+  case 'f':
+    rt_fasl_skip(p, 8);
+    return;
+  case 'b': {
+    long	count = rt_fasl_read_long(p);
+    rt_fasl_skip(p, (count < 0)? -count : count);
+    return;
+  }
+  default:
+    rt_fasl_fail(p);
+  }
+}
+
+static ikptr
+rt_fasl_marks_vector (ikpcb * pcb, rt_fasl_port * p)
+/* Return a new Scheme vector holding the table of marks. */
+{
+  ikptr	s_vec = ik_unsafe_alloc(pcb, IK_ALIGN(p->marks_size * wordsize + disp_vector_data)) | vector_tag;
+  long	i;
+  IK_REF(s_vec, off_vector_length) = IK_FIX(p->marks_size);
+  for (i=0; i<p->marks_size; ++i)
+    IK_ITEM(s_vec, i) = (p->marks[i])? p->marks[i] : IK_FALSE_OBJECT;
+  return s_vec;
+}
+
+static long
+rt_fasl_lazy_retained_bytes (ikptr s_descr)
+/* Return the number of octets kept alive by the lazy procedure descriptor
+   S_DESCR until its code object is loaded. */
+{
+  ikptr	s_marks = IK_ITEM(IK_ITEM(s_descr, 3), 0);
+  long	bytes   = IK_ALIGN(IK_BYTEVECTOR_LENGTH(IK_ITEM(s_descr, 1)) + disp_bytevector_data + 1);
+  if (ik_is_vector(s_marks))
+    bytes += IK_ALIGN(IK_VECTOR_LENGTH(s_marks) * wordsize + disp_vector_data);
+  return bytes;
+}
+static int
+rt_fasl_compact_lazy_marks (ikpcb * pcb, ikptr s_descr, ikptr * marks, long marks_size, uint32_t * remap)
+/* Give  the lazy procedure described by S_DESCR a table of marks of its
+   own, holding only the objects referenced by its code object; the
+   references in the serialised code object are renumbered accordingly.
+   MARKS is the table of marks of the whole FASL object, with MARKS_SIZE
+   slots; unset slots are NULL or false.  REMAP must be an array of
+   MARKS_SIZE zeros, it is left zeroed.
+
+   Return true if successful; if the serialised code object is invalid:
+   return false and leave the descriptor unchanged, so it still references
+   the table of the whole FASL object. */
+{
+  volatile int	done = 0;
+  ikptr		s_bv = IK_ITEM(s_descr, 1);
+  rt_fasl_port	p;
+  long		i;
+  p.s_bv		= s_bv;
+  p.memp		= IK_BYTEVECTOR_DATA_UINT8P(s_bv);
+  p.memq		= IK_BYTEVECTOR_DATA_UINT8P(s_bv) + IK_BYTEVECTOR_LENGTH(s_bv);
+  p.marks		= marks;
+  p.marks_size		= marks_size;
+  p.frozen_marks	= 1;
+  p.s_lazy_template	= IK_FALSE_OBJECT;
+  p.s_marks_holder	= 0;
+  p.shared_marks	= 0;
+  p.defined		= NULL;
+  p.defined_count	= 0;
+  p.defined_size	= 0;
+  p.marks_too_small	= 0;
+  p.remap		= remap;
+  p.remap_count		= 0;
+  p.remap_write		= 0;
+  p.lazy		= NULL;
+  if (0 == setjmp(p.failure)) {
+    /* First pass: collect the references; second pass: overwrite them. */
+    rt_fasl_scan(&p);
+    p.memp        = IK_BYTEVECTOR_DATA_UINT8P(s_bv);
+    p.remap_write = 1;
+    rt_fasl_scan(&p);
+    done = 1;
+  }
+  if (done) {
+    ikptr	s_marks  = ik_unsafe_alloc(pcb, IK_ALIGN((p.remap_count + 1) * wordsize + disp_vector_data)) | vector_tag;
+    ikptr	s_holder = ik_unsafe_alloc(pcb, IK_ALIGN(wordsize + disp_vector_data)) | vector_tag;
+    IK_REF(s_marks, off_vector_length) = IK_FIX(p.remap_count + 1);
+    IK_ITEM(s_marks, 0) = IK_FALSE_OBJECT;
+    for (i=0; i<p.defined_count; ++i) {
+      ikptr	s_obj = marks[p.defined[i]];
+      IK_ITEM(s_marks, remap[p.defined[i]]) = (s_obj)? s_obj : IK_FALSE_OBJECT;
+    }
+    IK_REF(s_holder, off_vector_length) = IK_FIX(1);
+    IK_ITEM(s_holder, 0) = s_marks;
+    IK_ITEM(s_descr, 3)  = s_holder;
+    IK_SIGNAL_DIRT_IN_PAGE_OF_POINTER(pcb, s_descr + off_vector_data + 3 * wordsize);
+  }
+  for (i=0; i<p.defined_count; ++i)
+    remap[p.defined[i]] = 0;
+  if (p.defined)
+    ik_free(p.defined, p.defined_size * sizeof(uint32_t));
+  return done;
+}
+static uint32_t *
+rt_fasl_make_remap (long marks_size)
+{
+  long		size  = (marks_size)? marks_size : 1;
+  uint32_t *	remap = ik_malloc(size * sizeof(uint32_t));
+  bzero(remap, size * sizeof(uint32_t));
+  return remap;
+}
+
+ikptr
+ikrt_fasl_read_bytevector_object (ikptr s_bv, ikptr s_start, ikptr s_lazy_template, ikpcb * pcb)
+/* Read a FASL object from the  bytevector S_BV starting at the offset
+   represented by the  non-negative fixnum S_START; the FASL header must
+   have already been consumed.  S_LAZY_TEMPLATE  must be the closure used
+   as template for the stubs of lazy procedures.  Return:
+
+   - A pair: the object as car, the offset of the first octet after it as
+     cdr.
+
+   - A vector: the object is prefixed by the identifier of a foreign shared
+     library to be loaded before building  it; the identifier string is
+     the first item, the offset of the next octet is the second item.
+
+   - False: the object cannot be read  by this function; the Scheme reader
+     must be used. */
+{
+  volatile ikptr	s_result = IK_FALSE_OBJECT;
+  rt_fasl_port		p;
+  long			start = IK_UNFIX(s_start);
+  long			len   = IK_BYTEVECTOR_LENGTH(s_bv);
+  if ((start < 0) || (start >= len))
+    return IK_FALSE_OBJECT;
+  p.s_bv		= s_bv;
+  p.memp		= IK_BYTEVECTOR_DATA_UINT8P(s_bv) + start;
+  p.memq		= IK_BYTEVECTOR_DATA_UINT8P(s_bv) + len;
+  p.marks		= NULL;
+  p.marks_size		= 0;
+  p.frozen_marks	= 0;
+  p.s_lazy_template	= s_lazy_template;
+  p.s_marks_holder	= 0;
+  p.shared_marks	= 0;
+  p.defined		= NULL;
+  p.marks_too_small	= 0;
+  p.remap		= NULL;
+  p.lazy		= NULL;
+  p.lazy_count		= 0;
+  p.lazy_size		= 0;
+  if ('O' != *p.memp) {
+    /* Give up before allocating anything if the object cannot be built. */
+    if (0 == setjmp(p.failure))
+      rt_fasl_scan(&p);
+    else
+      return IK_FALSE_OBJECT;
+    p.memp = IK_BYTEVECTOR_DATA_UINT8P(s_bv) + start;
+  }
+  if (0 == setjmp(p.failure)) {
+    if ('O' == *p.memp) {
+      ++p.memp;
+      s_result = rt_fasl_read(pcb, &p);
+      if (IK_IS_STRING(s_result)) {
+	ikptr	s_vec = ik_unsafe_alloc(pcb, IK_ALIGN(2 * wordsize + disp_vector_data)) | vector_tag;
+	IK_REF(s_vec, off_vector_length) = IK_FIX(2);
+	IK_ITEM(s_vec, 0) = s_result;
+	IK_ITEM(s_vec, 1) = IK_FIX(p.memp - IK_BYTEVECTOR_DATA_UINT8P(s_bv));
+	s_result = s_vec;
+      } else
+	s_result = IK_FALSE_OBJECT;
+    } else {
+      ikptr	s_obj  = rt_fasl_read(pcb, &p);
+      ikptr	s_pair = ik_unsafe_alloc(pcb, pair_size) | pair_tag;
+      if (p.s_marks_holder) {
+	/* The shared table of marks is needed only by the lazy procedures
+	   whose table cannot be compacted. */
+	uint32_t *	remap = rt_fasl_make_remap(p.marks_size);
+	int		all   = 1;
+	long		i;
+	IK_ITEM(p.s_marks_holder, 0) = IK_FALSE_OBJECT;
+	for (i=0; i<p.lazy_count; ++i)
+	  all = rt_fasl_compact_lazy_marks(pcb, p.lazy[i], p.marks, p.marks_size, remap) && all;
+	ik_free(remap, ((p.marks_size)? p.marks_size : 1) * sizeof(uint32_t));
+	if ((! all) && p.marks)
+	  IK_ITEM(p.s_marks_holder, 0) = rt_fasl_marks_vector(pcb, &p);
+	for (i=0; i<p.lazy_count; ++i)
+	  lazy_retained_bytes += rt_fasl_lazy_retained_bytes(p.lazy[i]);
+      }
+      IK_REF(s_pair, off_car) = s_obj;
+      IK_REF(s_pair, off_cdr) = IK_FIX(p.memp - IK_BYTEVECTOR_DATA_UINT8P(s_bv));
+      s_result = s_pair;
+    }
+  } else
+    s_result = IK_FALSE_OBJECT;
+  if (p.marks)
+    ik_free(p.marks, p.marks_size * sizeof(ikptr));
+  if (p.lazy)
+    ik_free(p.lazy, p.lazy_size * sizeof(ikptr));
+  return s_result;
+}
+
+ikptr
+ikrt_fasl_read_bytevector_code (ikptr s_bv, ikptr s_start, ikptr s_code_mark, ikptr s_closure_mark,
+				ikptr s_marks, ikpcb * pcb)
+/* Called by the Scheme reader to read a code object from the bytevector
+   S_BV, starting at  the offset S_START right after  the "x" header.
+   S_CODE_MARK and S_CLOSURE_MARK are false or the marks of the code object
+   and  of the closure  built  with it,  like the  arguments  of the Scheme
+   function "%read-code".   S_MARKS is the table of  marks of the Scheme
+   reader: the marks defined  by the code object are stored in it.  Return:
+
+   - A pair: the code object as car, the offset of the first octet after it
+     as cdr.
+
+   - True: S_MARKS is too small; the Scheme reader must enlarge it and try
+     again.
+
+   - False: the code object cannot be read by this function.
+
+   When giving up, the marks stored in S_MARKS are reset to false. */
+{
+  volatile ikptr	s_result = IK_FALSE_OBJECT;
+  rt_fasl_port		p;
+  long			start = IK_UNFIX(s_start);
+  long			len   = IK_BYTEVECTOR_LENGTH(s_bv);
+  long			i;
+  if ((start < 0) || (start >= len))
+    return IK_FALSE_OBJECT;
+  p.s_bv		= s_bv;
+  p.memp		= IK_BYTEVECTOR_DATA_UINT8P(s_bv) + start;
+  p.memq		= IK_BYTEVECTOR_DATA_UINT8P(s_bv) + len;
+  /* No allocation moves the vector while we read. */
+  p.marks		= (ikptr *)(long)(s_marks + off_vector_data);
+  p.marks_size		= IK_VECTOR_LENGTH(s_marks);
+  p.frozen_marks	= 0;
+  p.s_lazy_template	= IK_FALSE_OBJECT;
+  p.s_marks_holder	= 0;
+  p.shared_marks	= 1;
+  p.defined		= NULL;
+  p.defined_count	= 0;
+  p.defined_size	= 0;
+  p.marks_too_small	= 0;
+  p.remap		= NULL;
+  p.lazy		= NULL;
+  if (0 == setjmp(p.failure)) {
+    /* Scan first: give up before allocating if the code cannot be built. */
+    long	code_size = rt_fasl_read_length(&p);
+    rt_fasl_skip(&p, sizeof(ikptr));
+    rt_fasl_scan(&p);
+    rt_fasl_skip(&p, code_size);
+    rt_fasl_scan(&p);
+  } else
+    return IK_FALSE_OBJECT;
+  p.memp = IK_BYTEVECTOR_DATA_UINT8P(s_bv) + start;
+  if (0 == setjmp(p.failure)) {
+    uint32_t	code_mark    = (IK_FALSE_OBJECT == s_code_mark)?    0 : IK_UNFIX(s_code_mark);
+    uint32_t	closure_mark = (IK_FALSE_OBJECT == s_closure_mark)? 0 : IK_UNFIX(s_closure_mark);
+    ikptr	s_code       = rt_fasl_read_code(pcb, &p, code_mark, closure_mark);
+    ikptr	s_pair       = ik_unsafe_alloc(pcb, pair_size) | pair_tag;
+    IK_REF(s_pair, off_car) = s_code;
+    IK_REF(s_pair, off_cdr) = IK_FIX(p.memp - IK_BYTEVECTOR_DATA_UINT8P(s_bv));
+    s_result = s_pair;
+    /* The table of marks may be in an old generation. */
+    for (i=0; i<p.defined_count; ++i)
+      IK_SIGNAL_DIRT_IN_PAGE_OF_POINTER(pcb, (ikptr)(long)(p.marks + p.defined[i]));
+  } else {
+    for (i=0; i<p.defined_count; ++i)
+      p.marks[p.defined[i]] = IK_FALSE_OBJECT;
+    s_result = (p.marks_too_small)? IK_TRUE_OBJECT : IK_FALSE_OBJECT;
+  }
+  if (p.defined)
+    ik_free(p.defined, p.defined_size * sizeof(uint32_t));
+  return s_result;
+}
+
+
+/** --------------------------------------------------------------------
+ ** Lazy procedures.
+ ** ----------------------------------------------------------------- */
+
+ikptr
+ikrt_fasl_set_lazy_code (ikptr s_descr, ikptr s_code, ikpcb * pcb)
+/* Patch the stub  closure referenced by the lazy procedure descriptor
+   S_DESCR so that it executes the code object S_CODE; return the stub.
+
+   The stub has room  for one free variable, the code object has none: the
+   closure size  is the same once aligned, and the stale descriptor in the
+   unused slot is never looked at again. */
+{
+  ikptr	s_stub = IK_ITEM(s_descr, 0);
+  IK_REF(s_stub, off_closure_code) = s_code + off_code_data;
+  IK_SIGNAL_DIRT_IN_PAGE_OF_POINTER(pcb, s_stub + off_closure_code);
+  /* Drop the references to the serialised code and to the marks. */
+  lazy_retained_bytes -= rt_fasl_lazy_retained_bytes(s_descr);
+  IK_ITEM(s_descr, 1) = IK_FALSE_OBJECT;
+  IK_ITEM(s_descr, 3) = IK_FALSE_OBJECT;
+  ++lazy_loaded_count;
+  lazy_loaded_bytes += IK_UNFIX(IK_REF(s_code, off_code_code_size));
+  return s_stub;
+}
+ikptr
+ikrt_fasl_read_lazy_code (ikptr s_descr, ikpcb * pcb)
+/* Read the  code object  of the lazy procedure  referenced by  the
+   descriptor S_DESCR, then patch its stub closure.  Return the stub or
+   false if the code  object cannot be read by  this function; in the
+   latter case the Scheme reader must be used. */
+{
+  volatile ikptr	s_result = IK_FALSE_OBJECT;
+  ikptr			s_bv     = IK_ITEM(s_descr, 1);
+  ikptr			s_marks  = IK_ITEM(IK_ITEM(s_descr, 3), 0);
+  long			start    = IK_UNFIX(IK_ITEM(s_descr, 2));
+  rt_fasl_port		p;
+  if ((start < 0) || (start >= IK_BYTEVECTOR_LENGTH(s_bv)))
+    return IK_FALSE_OBJECT;
+  p.s_bv		= s_bv;
+  p.memp		= IK_BYTEVECTOR_DATA_UINT8P(s_bv) + start;
+  p.memq		= IK_BYTEVECTOR_DATA_UINT8P(s_bv) + IK_BYTEVECTOR_LENGTH(s_bv);
+  p.marks		= NULL;
+  p.marks_size		= 0;
+  p.frozen_marks	= 1;
+  p.s_lazy_template	= IK_FALSE_OBJECT;
+  p.s_marks_holder	= 0;
+  p.shared_marks	= 0;
+  p.defined		= NULL;
+  p.marks_too_small	= 0;
+  p.remap		= NULL;
+  p.lazy		= NULL;
+  if (ik_is_vector(s_marks)) {
+    /* No allocation moves the vector while we read. */
+    p.marks		= (ikptr *)(long)(s_marks + off_vector_data);
+    p.marks_size	= IK_VECTOR_LENGTH(s_marks);
+  }
+  if (0 == setjmp(p.failure)) {
+    ikptr	s_code = rt_fasl_read(pcb, &p);
+    if (IK_IS_CODE(s_code))
+      s_result = ikrt_fasl_set_lazy_code(s_descr, s_code, pcb);
+  }
+  return s_result;
+}
+ikptr
+ikrt_fasl_count_lazy_procedure (ikptr s_len)
+/* Called by the Scheme reader whenever it builds a lazy procedure. */
+{
+  ++lazy_procedures_count;
+  lazy_deferred_bytes += IK_UNFIX(s_len);
+  return IK_VOID_OBJECT;
+}
+ikptr
+ikrt_fasl_compact_lazy_marks (ikptr s_descr, ikptr s_marks, ikpcb * pcb)
+/* Called by the Scheme reader at the end of a read, for every lazy procedure
+   it has built; S_MARKS is its table of marks, already stored in the shared
+   marks holder.  Return true if the lazy procedure has now a table of marks
+   of its own, else false. */
+{
+  long		size  = IK_VECTOR_LENGTH(s_marks);
+  uint32_t *	remap = rt_fasl_make_remap(size);
+  /* No allocation moves the vector while we read. */
+  int		done  = rt_fasl_compact_lazy_marks(pcb, s_descr, (ikptr *)(long)(s_marks + off_vector_data),
+						   size, remap);
+  ik_free(remap, ((size)? size : 1) * sizeof(uint32_t));
+  lazy_retained_bytes += rt_fasl_lazy_retained_bytes(s_descr);
+  return (done)? IK_TRUE_OBJECT : IK_FALSE_OBJECT;
+}
+ikptr
+ikrt_fasl_lazy_code_statistics (ikpcb * pcb)
+/* Return a vector of fixnums:
+
+     #(procedures deferred-bytes loaded-procedures loaded-bytes retained-bytes)
+
+   the number of lazy procedures read  so far, the number of octets of
+   their serialised code objects, the number of lazy procedures called at
+   least once, the number of octets of their code objects' data areas, the
+   number of octets of serialised code objects and tables of marks held by
+   the stubs not yet loaded.  The last counter includes the stubs that have
+   since been garbage collected: it is an upper bound of the memory actually
+   retained, not a measure of resident memory. */
+{
+  ikptr	s_vec = ik_safe_alloc(pcb, IK_ALIGN(5 * wordsize + disp_vector_data)) | vector_tag;
+  IK_REF(s_vec, off_vector_length) = IK_FIX(5);
+  IK_ITEM(s_vec, 0) = IK_FIX(lazy_procedures_count);
+  IK_ITEM(s_vec, 1) = IK_FIX(lazy_deferred_bytes);
+  IK_ITEM(s_vec, 2) = IK_FIX(lazy_loaded_count);
+  IK_ITEM(s_vec, 3) = IK_FIX(lazy_loaded_bytes);
+  IK_ITEM(s_vec, 4) = IK_FIX(lazy_retained_bytes);
+  return s_vec;
+}
+
+
+/** --------------------------------------------------------------------
+ ** Compressed FASL containers.
+ ** ----------------------------------------------------------------- */
+
+/* A compressed FASL container holds FASL data split in blocks of at most
+   FASL_BLOCK_SIZE octets, each compressed on its own:
+
+     "#@IKZ1" or "#@IKZ2"		the header, selecting the word size
+     block ...				the blocks of data
+     0 0				the end marker
+
+   every block is  prefixed by 2 unsigned 32-bit  integers in little endian
+   order: the number of octets of  data and the number of octets stored in
+   the file; when the two are equal  the data is stored uncompressed.  The
+   end marker is a block header with zero octets of data.
+
+   The data of every block  is compressed in the LZ4 block format: a
+   sequence of tokens, each  holding a run of literal octets and a back
+   reference to a match of at least 4 octets at most 65535 octets back in
+   the same block.  The compressor is greedy  and single pass, it trades
+   ratio for speed; the decompressor validates every length and offset, so
+   corrupted data cannot make it write outside of the output buffer. */
+
+#define FASL_MIN_MATCH		4
+#define FASL_HASH_LOG		13
+#define FASL_MAX_OFFSET		65535
+/* The last match must start at least this many octets before the end of
+   the block, and the last octets of the block are always literals. */
+#define FASL_MATCH_MARGIN	12
+#define FASL_LITERALS_MARGIN	5
+
+static uint32_t
+ik_fasl_u32_ref (const uint8_t * p)
+{
+  return ((uint32_t)p[0]) | (((uint32_t)p[1]) << 8) | (((uint32_t)p[2]) << 16) | (((uint32_t)p[3]) << 24);
+}
+static inline uint32_t
+fasl_read32 (const uint8_t * p)
+{
+  uint32_t	v;
+  memcpy(&v, p, sizeof(uint32_t));
+  return v;
+}
+static inline uint8_t *
+fasl_put_length (uint8_t * op, long len)
+{
+  for (; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = (uint8_t)len;
+  return op;
+}
+static long
+fasl_compress (const uint8_t * src, long src_len, uint8_t * dst, long dst_len)
+/* Compress  the SRC_LEN  octets at  SRC into  the buffer  at DST  of
+   DST_LEN octets.  Return the number of octets written or -1 if the
+   compressed data does not fit. */
+{
+  int32_t		table[1 << FASL_HASH_LOG];
+  const uint8_t *	ip	= src;
+  const uint8_t *	anchor	= src;
+  const uint8_t *	iend	= src + src_len;
+  uint8_t *		op	= dst;
+  uint8_t *		oend	= dst + dst_len;
+  memset(table, 0xFF, sizeof(table));
+  if (src_len > FASL_MATCH_MARGIN) {
+    const uint8_t *	mflimit    = iend - FASL_MATCH_MARGIN;
+    const uint8_t *	matchlimit = iend - FASL_LITERALS_MARGIN;
+    while (ip < mflimit) {
+      uint32_t		seq  = fasl_read32(ip);
+      uint32_t		hash = (seq * 2654435761U) >> (32 - FASL_HASH_LOG);
+      long		ref  = table[hash];
+      const uint8_t *	match;
+      const uint8_t *	mend;
+      long		literals, match_len;
+      table[hash] = (int32_t)(ip - src);
+      if ((ref < 0) || ((ip - src) - ref > FASL_MAX_OFFSET) || (fasl_read32(src + ref) != seq)) {
+	++ip;
+	continue;
+      }
+      match = src + ref;
+      /* Extend the match backwards over the pending literals. */
+      while ((ip > anchor) && (match > src) && (ip[-1] == match[-1])) {
+	--ip;
+	--match;
+      }
+      mend = ip + FASL_MIN_MATCH;
+      for (match += FASL_MIN_MATCH; (mend < matchlimit) && (*mend == *match); ++mend, ++match)
+	;
+      literals  = ip - anchor;
+      match_len = mend - ip - FASL_MIN_MATCH;
+      /* Token, literal length, literals, offset, match length. */
+      if ((oend - op) < (1 + literals/255 + 1 + literals + 2 + match_len/255 + 1))
+	return -1;
+      {
+	uint8_t *	token  = op++;
+	long		offset = mend - match;
+	*token = (uint8_t)(((literals < 15)? literals : 15) << 4);
+	if (literals >= 15)
+	  op = fasl_put_length(op, literals - 15);
+	memcpy(op, anchor, literals);
+	op += literals;
+	*op++ = (uint8_t)(offset & 0xFF);
+	*op++ = (uint8_t)(offset >> 8);
+	*token |= (uint8_t)((match_len < 15)? match_len : 15);
+	if (match_len >= 15)
+	  op = fasl_put_length(op, match_len - 15);
+      }
+      ip = anchor = mend;
+    }
+  }
+  /* The last literals. */
+  {
+    long	literals = iend - anchor;
+    if ((oend - op) < (1 + literals/255 + 1 + literals))
+      return -1;
+    *op++ = (uint8_t)(((literals < 15)? literals : 15) << 4);
+    if (literals >= 15)
+      op = fasl_put_length(op, literals - 15);
+    memcpy(op, anchor, literals);
+    op += literals;
+  }
+  return op - dst;
+}
+static long
+fasl_decompress (const uint8_t * src, long src_len, uint8_t * dst, long dst_len)
+/* Decompress the SRC_LEN octets at SRC into  the buffer at DST of DST_LEN
+   octets.  Return the number of octets written or -1 if the data is
+   corrupted. */
+{
+  const uint8_t *	ip	= src;
+  const uint8_t *	iend	= src + src_len;
+  uint8_t *		op	= dst;
+  uint8_t *		oend	= dst + dst_len;
+  while (ip < iend) {
+    unsigned		token = *ip++;
+    long		len   = token >> 4;
+    long		offset;
+    if (15 == len) {
+      unsigned	b;
+      do {
+	if (ip == iend)
+	  return -1;
+	b    = *ip++;
+	len += b;
+      } while (255 == b);
+    }
+    if ((len > (iend - ip)) || (len > (oend - op)))
+      return -1;
+    memcpy(op, ip, len);
+    op += len;
+    ip += len;
+    if (ip == iend)
+      /* The last sequence has no match. */
+      break;
+    if ((iend - ip) < 2)
+      return -1;
+    offset = ((long)ip[0]) | (((long)ip[1]) << 8);
+    ip += 2;
+    if ((0 == offset) || (offset > (op - dst)))
+      return -1;
+    len = token & 15;
+    if (15 == len) {
+      unsigned	b;
+      do {
+	if (ip == iend)
+	  return -1;
+	b    = *ip++;
+	len += b;
+      } while (255 == b);
+    }
+    len += FASL_MIN_MATCH;
+    if (len > (oend - op))
+      return -1;
+    if (offset >= len) {
+      memcpy(op, op - offset, len);
+      op += len;
+    } else {
+      /* Overlapping match: a repeated pattern. */
+      const uint8_t *	match = op - offset;
+      while (len--)
+	*op++ = *match++;
+    }
+  }
+  return op - dst;
+}
+ikptr
+ikrt_fasl_compress_block (ikptr s_src, ikptr s_len, ikptr s_dst)
+/* Compress  the first  S_LEN octets of the  bytevector S_SRC into the
+   bytevector S_DST.  Return the number of octets written, or false if the
+   data does not shrink. */
+{
+  long	len = IK_UNFIX(s_len);
+  long	rv  = fasl_compress(IK_BYTEVECTOR_DATA_UINT8P(s_src), len,
+			    IK_BYTEVECTOR_DATA_UINT8P(s_dst), IK_BYTEVECTOR_LENGTH(s_dst));
+  return ((0 <= rv) && (rv < len))? IK_FIX(rv) : IK_FALSE_OBJECT;
+}
+ikptr
+ikrt_fasl_decompress_block (ikptr s_src, ikptr s_src_len, ikptr s_dst, ikptr s_dst_len)
+/* Decompress  the  first  S_SRC_LEN  octets  of  the  bytevector S_SRC
+   into the first  S_DST_LEN octets of the bytevector  S_DST.  Return the
+   number of octets written, or false if the data is corrupted. */
+{
+  long	src_len = IK_UNFIX(s_src_len);
+  long	dst_len = IK_UNFIX(s_dst_len);
+  long	rv;
+  if ((src_len > IK_BYTEVECTOR_LENGTH(s_src)) || (dst_len > IK_BYTEVECTOR_LENGTH(s_dst)))
+    return IK_FALSE_OBJECT;
+  rv = fasl_decompress(IK_BYTEVECTOR_DATA_UINT8P(s_src), src_len,
+		       IK_BYTEVECTOR_DATA_UINT8P(s_dst), dst_len);
+  return (0 <= rv)? IK_FIX(rv) : IK_FALSE_OBJECT;
 }
 
 /* end of file */
@@ -0,0 +1,534 @@
+/*
+  Part of: Vicare Scheme
+  Contents: saving and restoring heap images
+  Date: Sun Oct 18, 2026
+
+  Abstract
+
+	A heap image is a file holding the Vicare pages of a running process,
+	saved right after a full garbage collection; along with the pages it
+	holds  their slots  in the segments  vector and  dirty vector, the
+	guardians and the PCB roots.  When a process is started with a heap
+	image: rather than loading the boot file, the pages are memory mapped
+	from the file at the same  addresses they were saved from, so that
+	the  Scheme references  between  them are  still valid;  then  the
+	closure selected when saving the image is called.
+
+	  The only references that may need relocation are the addresses of
+	C functions  stored in code objects  by "foreign-call": when the
+	executable is loaded at a different address, they are resolved again.
+	The Scheme  pages are never relocated:  when the saved addresses are
+	not available, or the image was saved by another build, the image is
+	ignored and the boot file is loaded as usual.
+
+	  The file layout is:
+
+	  |--------|------|-------|------|-----------|-----|-------...------|
+	   header   runs   types   dirt   guardians   pad   pages
+
+	where: "runs" is an array of "ik_heap_image_run" structs, one for each
+	block  of contiguous  pages;  "types" and  "dirt"  are arrays  of
+	"uint32_t", one slot for  every saved page, in the order  of the runs;
+	"guardians" is  an array  of "ikptr",  for each  generation the tagged
+	pointers  in the  protected list;  "pad" aligns  the pages  to  the
+	Vicare page size.
+
+  Copyright (C) 2026 Marco Maggi <marco.maggi-ipsu@poste.it>
+
+  This program is  free software: you can redistribute  it and/or modify
+  it under the  terms of the GNU General Public  License as published by
+  the Free Software Foundation, either  version 3 of the License, or (at
+  your option) any later version.
+
+  This program  is distributed in the  hope that it will  be useful, but
+  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+  General Public License for more details.
+
+  You  should have received  a copy  of the  GNU General  Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/** --------------------------------------------------------------------
+ ** Headers.
+ ** ----------------------------------------------------------------- */
+
+#include "internals.h"
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define IK_HEAP_IMAGE_MAGIC		"vicare-heap-1"
+#define IK_HEAP_IMAGE_MAGIC_LEN		16
+
+/* Identifies the build of the  executable: an image saved by a different
+   build may reference objects and C functions laid out differently. */
+#define IK_HEAP_IMAGE_BUILD		PACKAGE_VERSION " " __DATE__ " " __TIME__
+#define IK_HEAP_IMAGE_BUILD_LEN		64
+
+typedef struct ik_heap_image_header {
+  char		magic[IK_HEAP_IMAGE_MAGIC_LEN];
+  char		build[IK_HEAP_IMAGE_BUILD_LEN];
+  ik_ulong	word_size;
+  ik_ulong	page_size;
+  ik_ulong	runs_count;
+  ik_ulong	pages_count;
+  ik_ulong	guardians_count[IK_GC_GENERATION_COUNT];
+  ik_ulong	collection_id;
+  /* The address of "ik_exec_code()" in the  process that saved the image;
+     if it is unchanged: the executable is  loaded at the same address and
+     the C function addresses in code objects are still valid. */
+  ikptr		witness;
+  ikptr		symbol_table;
+  ikptr		gensym_table;
+  ikptr		base_rtd;
+  /* The closure to call when the image is loaded. */
+  ikptr		entry;
+} ik_heap_image_header;
+
+/* A block of contiguous pages. */
+typedef struct ik_heap_image_run {
+  ikptr		base;
+  ik_ulong	pages;
+  /* Offset of the first page in the file. */
+  ik_ulong	offset;
+} ik_heap_image_run;
+
+/* The  image as  mapped by  "ik_map_heap_image()", waiting  for  the PCB. */
+typedef struct ik_heap_image {
+  ik_heap_image_header	header;
+  int			meta_size;
+  ik_heap_image_run *	runs;
+  uint32_t *		types;
+  uint32_t *		dirt;
+  ikptr *		guardians;
+} ik_heap_image;
+
+static int	saved_page_p		(uint32_t type);
+static int	write_all		(int fd, const void * buf, size_t len);
+static int	relocate_foreign_addresses (ik_heap_image * image);
+static void	build_identifier	(char * buf);
+static void	protect_guardian	(ikpcb * pcb, int gen, ikptr s_pair);
+
+
+/** --------------------------------------------------------------------
+ ** Saving heap images.
+ ** ----------------------------------------------------------------- */
+
+ikptr
+ikrt_save_heap_image (ikptr s_pathname, ikptr s_entry, ikpcb * pcb)
+/* Perform  a full garbage  collection, then save  the heap in  the file
+   selected by  the bytevector S_PATHNAME; S_ENTRY  must be the  closure to
+   call when the image is loaded.  The file  is written under a temporary
+   name, then renamed: a process running from  an old image at the same
+   pathname is not disturbed.
+
+   If successful return  true; otherwise return an  encoded "errno" value. */
+{
+  ik_heap_image_header	header;
+  ik_heap_image_run *	runs;
+  uint32_t *		types;
+  uint32_t *		dirt;
+  ikptr *		guardians;
+  int			meta_size;
+  char *		pathname;
+  char *		tmpname;
+  int			fd = -1;
+  int			errno_code = 0;
+  /* The pathname bytevector moves with the garbage collection. */
+  pathname = strdup(IK_BYTEVECTOR_DATA_CHARP(s_pathname));
+  tmpname  = malloc(strlen(pathname) + 8);
+  if ((NULL == pathname) || (NULL == tmpname)) {
+    free(pathname);
+    free(tmpname);
+    errno = ENOMEM;
+    return ik_errno_to_code();
+  }
+  sprintf(tmpname, "%s.XXXXXX", pathname);
+
+  /* Collect all the generations: after this  the nursery is empty and the
+     image holds only live objects. */
+  {
+    pcb->root0 = &s_entry;
+    pcb->collection_id = 255;
+    ik_collect(IK_PAGESIZE, pcb);
+    pcb->root0 = NULL;
+  }
+
+  /* Gather the runs of pages to save. */
+  bzero(&header, sizeof(ik_heap_image_header));
+  {
+    ik_ulong	page_idx     = IK_PAGE_INDEX(pcb->memory_base);
+    ik_ulong	page_idx_end = IK_PAGE_INDEX(pcb->memory_end);
+    int		in_run = 0;
+    for (; page_idx < page_idx_end; ++page_idx) {
+      if (saved_page_p(pcb->segment_vector[page_idx])) {
+	++header.pages_count;
+	if (! in_run)
+	  ++header.runs_count;
+	in_run = 1;
+      } else
+	in_run = 0;
+    }
+  }
+  {
+    int		gen;
+    for (gen=0; gen<IK_GC_GENERATION_COUNT; ++gen) {
+      ik_ptr_page *	node;
+      for (node = pcb->protected_list[gen]; node; node = node->next)
+	header.guardians_count[gen] += node->count;
+    }
+  }
+  {
+    ik_ulong	total_guardians = 0;
+    int		gen;
+    for (gen=0; gen<IK_GC_GENERATION_COUNT; ++gen)
+      total_guardians += header.guardians_count[gen];
+    meta_size = header.runs_count  * sizeof(ik_heap_image_run)
+      +         header.pages_count * 2 * sizeof(uint32_t)
+      +         total_guardians    * sizeof(ikptr);
+  }
+  runs      = ik_malloc(meta_size? meta_size : 1);
+  types     = (uint32_t *)(runs + header.runs_count);
+  dirt      = types + header.pages_count;
+  guardians = (ikptr *)(dirt + header.pages_count);
+  {
+    ik_ulong	offset       = IK_ALIGN_TO_NEXT_PAGE(sizeof(ik_heap_image_header) + meta_size);
+    ik_ulong	page_idx     = IK_PAGE_INDEX(pcb->memory_base);
+    ik_ulong	page_idx_end = IK_PAGE_INDEX(pcb->memory_end);
+    uint32_t *	dirty_vec    = (uint32_t *)pcb->dirty_vector;
+    long	run          = -1;
+    ik_ulong	page         = 0;
+    int		in_run       = 0;
+    for (; page_idx < page_idx_end; ++page_idx) {
+      if (saved_page_p(pcb->segment_vector[page_idx])) {
+	if (! in_run) {
+	  ++run;
+	  runs[run].base   = IK_PAGE_POINTER_FROM_INDEX(page_idx);
+	  runs[run].pages  = 0;
+	  runs[run].offset = offset;
+	}
+	in_run = 1;
+	++runs[run].pages;
+	types[page] = pcb->segment_vector[page_idx];
+	dirt[page]  = dirty_vec[page_idx];
+	++page;
+	offset += IK_PAGESIZE;
+      } else
+	in_run = 0;
+    }
+  }
+  {
+    ikptr *	slot = guardians;
+    int		gen;
+    for (gen=0; gen<IK_GC_GENERATION_COUNT; ++gen) {
+      ik_ptr_page *	node;
+      for (node = pcb->protected_list[gen]; node; node = node->next) {
+	memcpy(slot, node->ptr, node->count * sizeof(ikptr));
+	slot += node->count;
+      }
+    }
+  }
+  memcpy(header.magic, IK_HEAP_IMAGE_MAGIC, sizeof(IK_HEAP_IMAGE_MAGIC));
+  build_identifier(header.build);
+  header.word_size	= wordsize;
+  header.page_size	= IK_PAGESIZE;
+  header.collection_id	= pcb->collection_id;
+  header.witness	= (ikptr)ik_exec_code;
+  header.symbol_table	= pcb->symbol_table;
+  header.gensym_table	= pcb->gensym_table;
+  header.base_rtd	= pcb->base_rtd;
+  header.entry		= s_entry;
+
+  /* Write the file. */
+  fd = mkstemp(tmpname);
+  if (-1 == fd)
+    goto failure;
+  if (fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH))
+    goto failure;
+  if (write_all(fd, &header, sizeof(ik_heap_image_header)) ||
+      write_all(fd, runs, meta_size))
+    goto failure;
+  {
+    static const char	zeros[IK_PAGESIZE];
+    ik_ulong		len = sizeof(ik_heap_image_header) + meta_size;
+    if (write_all(fd, zeros, IK_ALIGN_TO_NEXT_PAGE(len) - len))
+      goto failure;
+  }
+  {
+    ik_ulong	i;
+    for (i=0; i<header.runs_count; ++i) {
+      if (write_all(fd, (void *)runs[i].base, runs[i].pages * IK_PAGESIZE))
+	goto failure;
+    }
+  }
+  if (close(fd)) {
+    fd = -1;
+    goto failure;
+  }
+  fd = -1;
+  if (rename(tmpname, pathname))
+    goto failure;
+  ik_free(runs, meta_size? meta_size : 1);
+  free(pathname);
+  free(tmpname);
+  return IK_TRUE_OBJECT;
+
+ failure:
+  errno_code = errno;
+  if (-1 != fd) {
+    close(fd);
+  }
+  unlink(tmpname);
+  ik_free(runs, meta_size? meta_size : 1);
+  free(pathname);
+  free(tmpname);
+  errno = errno_code;
+  return ik_errno_to_code();
+}
+static int
+saved_page_p (uint32_t type)
+/* Return true if  a page of type  TYPE must be saved in  the image.  The
+   nursery and the stack are empty or dead after a full garbage collection. */
+{
+  switch (type & TYPE_MASK) {
+  case HOLE_TYPE:
+  case MAINHEAP_TYPE:
+  case MAINSTACK_TYPE:
+    return 0;
+  default:
+    return 1;
+  }
+}
+static void
+build_identifier (char * buf)
+/* Fill  the IK_HEAP_IMAGE_BUILD_LEN bytes  at BUF with the  build identifier,
+   padded with zeros. */
+{
+  bzero(buf, IK_HEAP_IMAGE_BUILD_LEN);
+  strncpy(buf, IK_HEAP_IMAGE_BUILD, IK_HEAP_IMAGE_BUILD_LEN - 1);
+}
+static int
+write_all (int fd, const void * buf, size_t len)
+{
+  const char *	p = buf;
+  while (len) {
+    ssize_t	rv = write(fd, p, len);
+    if (-1 == rv) {
+      if (EINTR == errno)
+	continue;
+      return -1;
+    }
+    p   += rv;
+    len -= rv;
+  }
+  return 0;
+}
+
+
+/** --------------------------------------------------------------------
+ ** Loading heap images.
+ ** ----------------------------------------------------------------- */
+
+void *
+ik_map_heap_image (const char * filename)
+/* Open the heap  image FILENAME and map its pages  at their original
+   addresses.  This function must be called  before building the PCB, so
+   that the memory allocated for it does not take the addresses needed by
+   the image.  Return a pointer to be handed to "ik_run_heap_image()".
+
+     The pages are not relocated: if the image cannot be used as is, print a
+   warning,  release  what was mapped  and return  NULL; the  caller then
+   loads the boot  file.  This happens  when: the file is  not a heap image
+   saved by this build of the executable; the memory at the saved addresses
+   is  already in use,  for example because address  space layout
+   randomisation put a shared library there; a C function referenced by a
+   code object cannot be resolved. */
+{
+  ik_heap_image *	image = ik_malloc(sizeof(ik_heap_image));
+  const char *		reason;
+  ik_ulong		mapped = 0;
+  int			fd;
+  image->meta_size = 0;
+  image->runs      = NULL;
+  fd = open(filename, O_RDONLY);
+  if (-1 == fd) {
+    reason = strerror(errno);
+    goto failure;
+  }
+  if (sizeof(ik_heap_image_header) != pread(fd, &image->header, sizeof(ik_heap_image_header), 0)) {
+    reason = "failed to read the header";
+    goto failure;
+  }
+  if ((0 != memcmp(image->header.magic, IK_HEAP_IMAGE_MAGIC, sizeof(IK_HEAP_IMAGE_MAGIC))) ||
+      (wordsize    != image->header.word_size) ||
+      (IK_PAGESIZE != image->header.page_size)) {
+    reason = "not a heap image for this platform";
+    goto failure;
+  }
+  {
+    char	build[IK_HEAP_IMAGE_BUILD_LEN];
+    build_identifier(build);
+    if (0 != memcmp(image->header.build, build, IK_HEAP_IMAGE_BUILD_LEN)) {
+      reason = "saved by a different build of the executable";
+      goto failure;
+    }
+  }
+  {
+    ik_ulong	total_guardians = 0;
+    int		gen;
+    for (gen=0; gen<IK_GC_GENERATION_COUNT; ++gen)
+      total_guardians += image->header.guardians_count[gen];
+    image->meta_size = image->header.runs_count  * sizeof(ik_heap_image_run)
+      +                image->header.pages_count * 2 * sizeof(uint32_t)
+      +                total_guardians           * sizeof(ikptr);
+  }
+  image->runs      = ik_malloc(image->meta_size? image->meta_size : 1);
+  image->types     = (uint32_t *)(image->runs + image->header.runs_count);
+  image->dirt      = image->types + image->header.pages_count;
+  image->guardians = (ikptr *)(image->dirt + image->header.pages_count);
+  if (image->meta_size != pread(fd, image->runs, image->meta_size, sizeof(ik_heap_image_header))) {
+    reason = "failed to read the pages table";
+    goto failure;
+  }
+  for (; mapped<image->header.runs_count; ++mapped) {
+    ik_heap_image_run *	run = &(image->runs[mapped]);
+    errno = 0;
+    if (0 == ik_mmap_file_at(run->base, run->pages * IK_PAGESIZE, fd, run->offset)) {
+      reason = ((0 == errno) || (EEXIST == errno))? "memory already in use" : strerror(errno);
+      goto failure;
+    }
+  }
+  /* The executable or  a shared library may  be loaded at an address
+     different from the  saving process: resolve again the  C functions now,
+     while it is still possible to fall back to the boot file. */
+  if (((ikptr)ik_exec_code != image->header.witness) && relocate_foreign_addresses(image)) {
+    reason = "unresolved C function";
+    goto failure;
+  }
+  close(fd);
+  return image;
+
+ failure:
+  fprintf(stderr, "*** Vicare warning: cannot use heap image file \"%s\", loading the boot file: %s\n",
+	  filename, reason);
+  while (mapped) {
+    ik_heap_image_run *	run = &(image->runs[--mapped]);
+    ik_munmap(run->base, run->pages * IK_PAGESIZE);
+  }
+  if (-1 != fd)
+    close(fd);
+  if (image->runs)
+    ik_free(image->runs, image->meta_size? image->meta_size : 1);
+  ik_free(image, sizeof(ik_heap_image));
+  return NULL;
+}
+void
+ik_run_heap_image (ikpcb * pcb, void * _image)
+/* Register in PCB the pages mapped by "ik_map_heap_image()", restore the
+   roots, then call the entry closure of the image. */
+{
+  ik_heap_image *	image = _image;
+  ik_heap_image_header	header = image->header;
+  {
+    ik_ulong	i, page;
+    for (i=0, page=0; i<header.runs_count; ++i) {
+      ik_heap_image_run *	run = &(image->runs[i]);
+      ik_adopt_pages(run->base, run->pages * IK_PAGESIZE, image->types + page, image->dirt + page, pcb);
+      page += run->pages;
+    }
+  }
+  {
+    ikptr *	slot = image->guardians;
+    int		gen;
+    ik_ulong	i;
+    for (gen=0; gen<IK_GC_GENERATION_COUNT; ++gen) {
+      for (i=0; i<header.guardians_count[gen]; ++i)
+	protect_guardian(pcb, gen, *slot++);
+    }
+  }
+  pcb->symbol_table	= header.symbol_table;
+  pcb->gensym_table	= header.gensym_table;
+  pcb->base_rtd		= header.base_rtd;
+  pcb->collection_id	= header.collection_id;
+  ik_free(image->runs, image->meta_size? image->meta_size : 1);
+  ik_free(image, sizeof(ik_heap_image));
+  {
+    ikptr	s_entry = header.entry;
+    ikptr	s_code  = IK_REF(s_entry, off_closure_code) - off_code_data;
+    ik_exec_code(pcb, s_code, IK_FIX(0), s_entry);
+  }
+}
+static int
+relocate_foreign_addresses (ik_heap_image * image)
+/* Visit all the  code objects in the image and  store again the address of
+   the C functions referenced by the  relocation vectors.  Only the words
+   whose value changed are written, so that unchanged pages are not copied.
+
+     Return 0 if all the functions  are resolved; return -1 if one of them is
+   not  found: the  image references  a function  this process  does not
+   have, calling the stale address would crash. */
+{
+  ik_ulong	i, j, page;
+  for (i=0, page=0; i<image->header.runs_count; ++i) {
+    ik_heap_image_run *	run = &(image->runs[i]);
+    for (j=0; j<run->pages; ++j, ++page) {
+      ikptr	page_start = run->base + j * IK_PAGESIZE;
+      ikptr	page_end   = page_start + IK_PAGESIZE;
+      ikptr	p_code     = page_start;
+      if (CODE_TYPE != (image->types[page] & TYPE_MASK))
+	continue;
+      /* Iterate over all the code objects in the page, in the same way of
+	 the garbage collector. */
+      while ((p_code < page_end) && (code_tag == IK_REF(p_code, 0))) {
+	ikptr	s_reloc_vec	= IK_REF(p_code, disp_code_reloc_vector);
+	ikptr	p_data		= p_code + disp_code_data;
+	ikptr	p_reloc_cur	= s_reloc_vec + off_vector_data;
+	ikptr	p_reloc_end	= p_reloc_cur + IK_VECTOR_LENGTH_FX(s_reloc_vec);
+	while (p_reloc_cur < p_reloc_end) {
+	  long	bits = IK_UNFIX(IK_RELOC_RECORD_1ST(p_reloc_cur));
+	  long	off  = IK_RELOC_RECORD_1ST_BITS_OFFSET(bits);
+	  switch (IK_RELOC_RECORD_1ST_BITS_TAG(bits)) {
+	  case IK_RELOC_RECORD_FOREIGN_ADDRESS_TAG: {
+	    void *	sym = dlsym(RTLD_DEFAULT, IK_BYTEVECTOR_DATA_CHARP(IK_RELOC_RECORD_2ND(p_reloc_cur)));
+	    if (NULL == sym)
+	      return -1;
+	    if ((ikptr)sym != IK_REF(p_data, off))
+	      IK_REF(p_data, off) = (ikptr)sym;
+	    p_reloc_cur += 2*wordsize;
+	    break;
+	  }
+	  case IK_RELOC_RECORD_VANILLA_OBJECT_TAG:
+	    p_reloc_cur += 2*wordsize;
+	    break;
+	  default:
+	    p_reloc_cur += 3*wordsize;
+	    break;
+	  }
+	}
+	p_code += IK_ALIGN(IK_UNFIX(IK_REF(p_code, disp_code_code_size)) + disp_code_data);
+      }
+    }
+  }
+  return 0;
+}
+static void
+protect_guardian (ikpcb * pcb, int gen, ikptr s_pair)
+/* Push a guardian pair on the protected list of generation GEN, like
+   "ikrt_register_guardian_pair()" does for the guardians generation. */
+{
+  ik_ptr_page *	first = pcb->protected_list[gen];
+  if ((NULL == first) || (IK_PTR_PAGE_NUMBER_OF_GUARDIANS_SLOTS == first->count)) {
+    ik_ptr_page *	new_node = (ik_ptr_page*)ik_mmap(IK_PAGESIZE);
+    new_node->count = 0;
+    new_node->next  = first;
+    first           = new_node;
+    pcb->protected_list[gen] = new_node;
+  }
+  first->ptr[first->count++] = s_pair;
+}
+
+/* end of file */
@@ -30,6 +30,16 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/uio.h>
+#ifdef HAVE_SYS_SENDFILE_H
+#  include <sys/sendfile.h>
+#endif
+
+/* True if  ERRNO_VALUE,  set by a  kernel  copy  function, means that  the
+   function does not support the given descriptors.  Every other error, like
+   EBADF or ESPIPE, is a real error and it is reported to the caller. */
+#define IK_COPY_FD_UNSUPPORTED(ERRNO_VALUE)			\
+  ((EINVAL == (ERRNO_VALUE)) || (EXDEV == (ERRNO_VALUE)) ||	\
+   (ENOSYS == (ERRNO_VALUE)) || (EOPNOTSUPP == (ERRNO_VALUE)))
 
 /* file descriptors */
 #define IK_FD_TO_NUM(fd)		IK_FIX(fd)
@@ -189,6 +199,407 @@ ikrt_write_fd (ikptr fd, ikptr buffer_bv, ikptr buffer_offset, ikptr requested_c
   return (0 <= rv)? IK_FIX(rv) : ik_errno_to_code();
 }
 
+/* ------------------------------------------------------------------ */
+
+#ifdef IOV_MAX
+#  define IK_IOVEC_MAX		IOV_MAX
+#else
+#  define IK_IOVEC_MAX		1024
+#endif
+
+static int
+ik_fill_iovec (ikptr s_buffers, struct iovec * bufs)
+/* Fill BUFS with the ranges described by the list S_BUFFERS and return the
+   number of  used entries; at most  IK_IOVEC_MAX entries are  used, so the
+   tail of a longer list is ignored.  Each item in S_BUFFERS is either a
+   bytevector, representing all its octets, or a pair whose car is a bytevector
+   and whose cdr is a pair of fixnums START and PAST, representing the octets
+   in the range [START, PAST). */
+{
+  ikptr		item;
+  ikptr		bv;
+  long		start, past;
+  int		i;
+  for (i=0; (i < IK_IOVEC_MAX) && (pair_tag == IK_TAGOF(s_buffers)); s_buffers=IK_CDR(s_buffers)) {
+    item = IK_CAR(s_buffers);
+    if (pair_tag == IK_TAGOF(item)) {
+      bv    = IK_CAR(item);
+      start = IK_UNFIX(IK_CAR(IK_CDR(item)));
+      past  = IK_UNFIX(IK_CDR(IK_CDR(item)));
+    } else {
+      bv    = item;
+      start = 0;
+      past  = IK_BYTEVECTOR_LENGTH(bv);
+    }
+    if (start < past) {
+      bufs[i].iov_base = IK_BYTEVECTOR_DATA_UINT8P(bv) + start;
+      bufs[i].iov_len  = (size_t)(past - start);
+      ++i;
+    }
+  }
+  return i;
+}
+ikptr
+ikrt_writev_fd (ikptr s_fd, ikptr s_buffers, ikpcb * pcb)
+/* Gather-write  to the  file descriptor  S_FD the  octets described  by the
+   list S_BUFFERS,  see "ik_fill_iovec()"  for the format  of the items.  Return
+   the number of octets written or a negative fixnum representing an errno code.
+   Like "write()" this may perform a partial write. */
+{
+  struct iovec	bufs[IK_IOVEC_MAX];
+  int		number_of_buffers;
+  ssize_t	rv;
+  number_of_buffers = ik_fill_iovec(s_buffers, bufs);
+  if (0 == number_of_buffers)
+    return IK_FIX(0);
+  errno = 0;
+  rv    = writev(IK_NUM_TO_FD(s_fd), bufs, number_of_buffers);
+  return (0 <= rv)? ika_integer_from_ssize_t(pcb, rv) : ik_errno_to_code();
+}
+ikptr
+ikrt_readv_fd (ikptr s_fd, ikptr s_buffers, ikpcb * pcb)
+/* Scatter-read from the file descriptor S_FD  into the ranges described by the
+   list S_BUFFERS,  see "ik_fill_iovec()"  for the format  of the items.  Return
+   the number of octets read, zero at end of file, or a negative fixnum
+   representing an errno code. */
+{
+  struct iovec	bufs[IK_IOVEC_MAX];
+  int		number_of_buffers;
+  ssize_t	rv;
+  number_of_buffers = ik_fill_iovec(s_buffers, bufs);
+  if (0 == number_of_buffers)
+    return IK_FIX(0);
+  errno = 0;
+  rv    = readv(IK_NUM_TO_FD(s_fd), bufs, number_of_buffers);
+  return (0 <= rv)? ika_integer_from_ssize_t(pcb, rv) : ik_errno_to_code();
+}
+
+/* ------------------------------------------------------------------ */
+
+ikptr
+ikrt_copy_fd (ikptr s_dst_fd, ikptr s_src_fd, ikptr s_count, ikpcb * pcb)
+/* Move at most S_COUNT octets from the  file descriptor S_SRC_FD to the file
+   descriptor S_DST_FD without copying them  to user space; the offsets of the
+   descriptors are used and updated.  Try in order: "copy_file_range()", which
+   needs two regular files; "sendfile()", which needs an input file that can
+   be mapped; "splice()", which needs a pipe at one end.  Return the number of
+   moved octets, zero at end of file, or a negative fixnum representing an
+   errno code; EINVAL means that no system call supports the descriptors.
+
+   "copy_file_range()" is skipped when the output descriptor is in append
+   mode, because it rejects it with EBADF.  Some file systems report zero
+   octets from "copy_file_range()" even when there is data: the caller must
+   fall back to reading and writing if zero is returned before any octet
+   has been moved. */
+{
+#if ((defined HAVE_COPY_FILE_RANGE) || (defined HAVE_SENDFILE) || (defined HAVE_SPLICE))
+  int		dst   = IK_NUM_TO_FD(s_dst_fd);
+  int		src   = IK_NUM_TO_FD(s_src_fd);
+  size_t	count = (size_t)IK_UNFIX(s_count);
+  ssize_t	rv;
+#ifdef HAVE_COPY_FILE_RANGE
+  errno = 0;
+  rv    = fcntl(dst, F_GETFL);
+  if (-1 == rv)
+    return ik_errno_to_code();
+  if (0 == (O_APPEND & rv)) {
+    errno = 0;
+    rv    = copy_file_range(src, NULL, dst, NULL, count, 0);
+    if (0 <= rv)
+      return ika_integer_from_ssize_t(pcb, rv);
+    else if (! IK_COPY_FD_UNSUPPORTED(errno))
+      return ik_errno_to_code();
+  }
+#endif
+#ifdef HAVE_SENDFILE
+  errno = 0;
+  rv    = sendfile(dst, src, NULL, count);
+  if (0 <= rv)
+    return ika_integer_from_ssize_t(pcb, rv);
+  else if (! IK_COPY_FD_UNSUPPORTED(errno))
+    return ik_errno_to_code();
+#endif
+#ifdef HAVE_SPLICE
+  errno = 0;
+  rv    = splice(src, NULL, dst, NULL, count, SPLICE_F_MOVE);
+  if (0 <= rv)
+    return ika_integer_from_ssize_t(pcb, rv);
+  else if (! IK_COPY_FD_UNSUPPORTED(errno))
+    return ik_errno_to_code();
+#endif
+  errno = EINVAL;
+  return ik_errno_to_code();
+#else
+  errno = EINVAL;
+  return ik_errno_to_code();
+#endif
+}
+
+
+/** --------------------------------------------------------------------
+ ** Transcoding blocks of characters for Scheme ports.
+ ** ----------------------------------------------------------------- */
+
+#define IK_ASCII_WORD_MASK	((uint64_t)0x8080808080808080ULL)
+
+static inline int
+ik_utf8_is_line_ending (uint32_t code_point)
+/* Return true if CODE_POINT is part of a line ending sequence. */
+{
+  return ((0x000A == code_point) || (0x000D == code_point) ||
+	  (0x0085 == code_point) || (0x2028 == code_point));
+}
+static inline int
+ik_utf8_is_continuation (uint8_t octet)
+{
+  return (0x80 == (octet & 0xC0));
+}
+ikptr
+ikrt_utf8_line_length (ikptr s_src, ikptr s_src_start, ikptr s_src_past)
+/* Scan the UTF-8  octets in the bytevector S_SRC, in  the range [S_SRC_START,
+   S_SRC_PAST), and return a fixnum  representing the number of octets before
+   the first line ending: linefeed, carriage return, next line (C2 85) or line
+   separator (E2 80  A8).  If there is no  line ending: return the length of
+   the range.  The  number of characters in a line  is at most its number of
+   octets, so this is the size of a string big enough to decode the line. */
+{
+  const uint8_t *	src	= IK_BYTEVECTOR_DATA_UINT8P(s_src);
+  long			start	= IK_UNFIX(s_src_start);
+  long			past	= IK_UNFIX(s_src_past);
+  long			si;
+  for (si=start; si<past; ++si) {
+    switch (src[si]) {
+    case 0x0A:
+    case 0x0D:
+      return IK_FIX(si - start);
+    case 0xC2:
+      if ((si+1 < past) && (0x85 == src[si+1]))
+	return IK_FIX(si - start);
+      break;
+    case 0xE2:
+      if ((si+2 < past) && (0x80 == src[si+1]) && (0xA8 == src[si+2]))
+	return IK_FIX(si - start);
+      break;
+    }
+  }
+  return IK_FIX(past - start);
+}
+ikptr
+ikrt_utf8_decode_block (ikptr s_src, ikptr s_src_start, ikptr s_src_past,
+			ikptr s_dst, ikptr s_dst_start, ikptr s_dst_past,
+			ikptr s_stop_at_line_ending, ikpcb * pcb)
+/* Decode the  UTF-8 octets in the  bytevector S_SRC, in the  range [S_SRC_START,
+   S_SRC_PAST),  and store  the characters  in  the string  S_DST starting  at
+   S_DST_START and  not beyond  S_DST_PAST.  Decoding stops:  when the source
+   range is exhausted; when the destination  range is full; before an octet that
+   does not start a  valid and complete UTF-8 sequence in  the source range; if
+   S_STOP_AT_LINE_ENDING is true, before a character being part of a line ending.
+
+   Return a pair whose car is the index in S_SRC of the first octet not decoded
+   and whose cdr is  the index in S_DST one past the  last stored character.  The
+   characters that stopped the decoding are left to the caller, which handles
+   them with the full machinery of error handling modes and buffer refilling. */
+{
+  const uint8_t *	src	= IK_BYTEVECTOR_DATA_UINT8P(s_src);
+  long			si	= IK_UNFIX(s_src_start);
+  long			spast	= IK_UNFIX(s_src_past);
+  ikchar *		dst	= (ikchar *)IK_STRING_DATA_VOIDP(s_dst);
+  long			di	= IK_UNFIX(s_dst_start);
+  long			dpast	= IK_UNFIX(s_dst_past);
+  int			stop_at_eol = (IK_FALSE != s_stop_at_line_ending);
+  ikptr			s_pair;
+  while ((si < spast) && (di < dpast)) {
+    /* ASCII fast path: 8 octets at once when they are all below 128 and the
+       destination has room for them. */
+    if (((spast - si) >= 8) && ((dpast - di) >= 8)) {
+      uint64_t	word;
+      memcpy(&word, src + si, sizeof(word));
+      if (0 == (word & IK_ASCII_WORD_MASK)) {
+	int	i;
+	if (stop_at_eol) {
+	  for (i=0; i<8; ++i, ++si) {
+	    if ((0x0A == src[si]) || (0x0D == src[si]))
+	      goto done;
+	    dst[di++] = IK_CHAR32_FROM_INTEGER(src[si]);
+	  }
+	} else {
+	  for (i=0; i<8; ++i)
+	    dst[di+i] = IK_CHAR32_FROM_INTEGER(src[si+i]);
+	  si += 8;
+	  di += 8;
+	}
+	continue;
+      }
+    }
+    {
+      uint8_t	octet0 = src[si];
+      uint32_t	code_point;
+      int	len;
+      if (octet0 < 0x80) {
+	code_point = octet0;
+	len = 1;
+      } else if (0xC0 == (octet0 & 0xE0)) {
+	if (((spast - si) < 2) || (! ik_utf8_is_continuation(src[si+1])))
+	  break;
+	code_point = ((octet0 & 0x1F) << 6) | (src[si+1] & 0x3F);
+	if (code_point < 0x80)
+	  break;
+	len = 2;
+      } else if (0xE0 == (octet0 & 0xF0)) {
+	if (((spast - si) < 3) ||
+	    (! ik_utf8_is_continuation(src[si+1])) ||
+	    (! ik_utf8_is_continuation(src[si+2])))
+	  break;
+	code_point = ((octet0 & 0x0F) << 12) | ((src[si+1] & 0x3F) << 6) | (src[si+2] & 0x3F);
+	if ((code_point < 0x800) || ((0xD800 <= code_point) && (code_point <= 0xDFFF)))
+	  break;
+	len = 3;
+      } else if (0xF0 == (octet0 & 0xF8)) {
+	if (((spast - si) < 4) ||
+	    (! ik_utf8_is_continuation(src[si+1])) ||
+	    (! ik_utf8_is_continuation(src[si+2])) ||
+	    (! ik_utf8_is_continuation(src[si+3])))
+	  break;
+	code_point = ((octet0 & 0x07) << 18) | ((src[si+1] & 0x3F) << 12) |
+	  ((src[si+2] & 0x3F) << 6) | (src[si+3] & 0x3F);
+	if ((code_point < 0x10000) || (0x10FFFF < code_point))
+	  break;
+	len = 4;
+      } else
+	break;
+      if (stop_at_eol && ik_utf8_is_line_ending(code_point))
+	break;
+      dst[di++] = IK_CHAR32_FROM_INTEGER(code_point);
+      si += len;
+    }
+  }
+ done:
+  s_pair = ika_pair_alloc(pcb);
+  IK_CAR(s_pair) = IK_FIX(si);
+  IK_CDR(s_pair) = IK_FIX(di);
+  return s_pair;
+}
+
+ikptr
+ikrt_utf8_encode_block (ikptr s_src, ikptr s_src_start, ikptr s_src_past,
+			ikptr s_dst, ikptr s_dst_start, ikptr s_dst_past,
+			ikptr s_stop_at_linefeed, ikpcb * pcb)
+/* Encode with  UTF-8 the characters in  the string S_SRC, in  the range
+   [S_SRC_START, S_SRC_PAST), and store the octets in the bytevector S_DST
+   starting at S_DST_START and not beyond S_DST_PAST.  Encoding stops: when
+   the source range is exhausted; before a character whose encoding does
+   not fit in the destination range; if S_STOP_AT_LINEFEED is true, before
+   a linefeed character.
+
+   Return a pair whose car is the index in S_SRC of the first character not
+   encoded and whose cdr is the index in S_DST one past the last stored
+   octet. */
+{
+  const ikchar *	src	= (ikchar *)IK_STRING_DATA_VOIDP(s_src);
+  long			si	= IK_UNFIX(s_src_start);
+  long			spast	= IK_UNFIX(s_src_past);
+  uint8_t *		dst	= IK_BYTEVECTOR_DATA_UINT8P(s_dst);
+  long			di	= IK_UNFIX(s_dst_start);
+  long			dpast	= IK_UNFIX(s_dst_past);
+  int			stop_at_lf = (IK_FALSE != s_stop_at_linefeed);
+  ikptr			s_pair;
+  for (; si < spast; ++si) {
+    uint32_t	code_point = IK_CHAR_TO_INTEGER(src[si]);
+    if (code_point < 0x80) {
+      if ((stop_at_lf && (0x0A == code_point)) || (di >= dpast))
+	break;
+      dst[di++] = (uint8_t)code_point;
+    } else if (code_point < 0x800) {
+      if ((dpast - di) < 2)
+	break;
+      dst[di++] = (uint8_t)(0xC0 | (code_point >> 6));
+      dst[di++] = (uint8_t)(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+      if ((dpast - di) < 3)
+	break;
+      dst[di++] = (uint8_t)(0xE0 | (code_point >> 12));
+      dst[di++] = (uint8_t)(0x80 | ((code_point >> 6) & 0x3F));
+      dst[di++] = (uint8_t)(0x80 | (code_point & 0x3F));
+    } else {
+      if ((dpast - di) < 4)
+	break;
+      dst[di++] = (uint8_t)(0xF0 | (code_point >> 18));
+      dst[di++] = (uint8_t)(0x80 | ((code_point >> 12) & 0x3F));
+      dst[di++] = (uint8_t)(0x80 | ((code_point >> 6) & 0x3F));
+      dst[di++] = (uint8_t)(0x80 | (code_point & 0x3F));
+    }
+  }
+  s_pair = ika_pair_alloc(pcb);
+  IK_CAR(s_pair) = IK_FIX(si);
+  IK_CDR(s_pair) = IK_FIX(di);
+  return s_pair;
+}
+ikptr
+ikrt_latin1_encode_block (ikptr s_src, ikptr s_src_start, ikptr s_src_past,
+			  ikptr s_dst, ikptr s_dst_start, ikptr s_dst_past,
+			  ikptr s_stop_at_linefeed, ikpcb * pcb)
+/* Like "ikrt_utf8_encode_block()" but  encode with Latin-1; encoding also
+   stops before a character that cannot be encoded by Latin-1, so that the
+   caller can honor the error handling mode of the transcoder. */
+{
+  const ikchar *	src	= (ikchar *)IK_STRING_DATA_VOIDP(s_src);
+  long			si	= IK_UNFIX(s_src_start);
+  long			spast	= IK_UNFIX(s_src_past);
+  uint8_t *		dst	= IK_BYTEVECTOR_DATA_UINT8P(s_dst);
+  long			di	= IK_UNFIX(s_dst_start);
+  long			dpast	= IK_UNFIX(s_dst_past);
+  int			stop_at_lf = (IK_FALSE != s_stop_at_linefeed);
+  ikptr			s_pair;
+  for (; (si < spast) && (di < dpast); ++si) {
+    uint32_t	code_point = IK_CHAR_TO_INTEGER(src[si]);
+    if ((0xFF < code_point) || (stop_at_lf && (0x0A == code_point)))
+      break;
+    dst[di++] = (uint8_t)code_point;
+  }
+  s_pair = ika_pair_alloc(pcb);
+  IK_CAR(s_pair) = IK_FIX(si);
+  IK_CDR(s_pair) = IK_FIX(di);
+  return s_pair;
+}
+
+
+/** --------------------------------------------------------------------
+ ** Memory-mapped input files for Scheme ports.
+ ** ----------------------------------------------------------------- */
+
+ikptr
+ikrt_fd_file_size (ikptr s_fd, ikpcb * pcb)
+/* Return  an exact  integer representing  the  size of  the file  referenced  by
+   S_FD; if an error occurs return an encoded "errno" value. */
+{
+  struct stat	S;
+  int		rv;
+  errno = 0;
+  rv    = fstat(IK_NUM_TO_FD(s_fd), &S);
+  return (0 == rv)? ika_integer_from_off_t(pcb, S.st_size) : ik_errno_to_code();
+}
+ikptr
+ikrt_mmap_read (ikptr s_base, ikptr s_base_size, ikptr s_position,
+		ikptr s_dst, ikptr s_dst_start, ikptr s_requested_count)
+/* Copy into the bytevector S_DST, starting at S_DST_START, at most
+   S_REQUESTED_COUNT octets from the memory  mapping starting at the pointer
+   S_BASE and S_BASE_SIZE octets wide, reading from offset S_POSITION.  Return
+   a fixnum representing the number of octets copied: zero if S_POSITION is at
+   or past the end of the mapping. */
+{
+  size_t	size     = ik_integer_to_size_t(s_base_size);
+  size_t	position = ik_integer_to_size_t(s_position);
+  size_t	count    = IK_UNFIX(s_requested_count);
+  if (position >= size)
+    return IK_FIX(0);
+  if (count > (size - position))
+    count = size - position;
+  memcpy(IK_BYTEVECTOR_DATA_UINT8P(s_dst) + IK_UNFIX(s_dst_start),
+	 ((uint8_t *)IK_POINTER_DATA_VOIDP(s_base)) + position,
+	 count);
+  return IK_FIX(count);
+}
+
 
 /** --------------------------------------------------------------------
  ** File descriptors handling for Scheme ports: port position.
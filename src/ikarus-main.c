@@ -43,21 +43,43 @@ ik_the_pcb (void)
 }
 
 
+static ikptr
+prepend_argument (ikpcb * pcb, char * s, ikptr arg_list)
+/* Convert the  string S to a  bytevector and prepend it  to ARG_LIST. */
+{
+  int	n = strlen(s);
+  ikptr	bv = ik_unsafe_alloc(pcb, IK_ALIGN(disp_bytevector_data+n+1)) | bytevector_tag;
+  IK_REF(bv, off_bytevector_length) = IK_FIX(n);
+  /* copy the bytes and the terminating zero */
+  memcpy((char*)(bv+off_bytevector_data), s, n+1);
+  ikptr p = iku_pair_alloc(pcb);
+  IK_CAR(p) = bv;
+  IK_CDR(p) = arg_list;
+  return p;
+}
+
 int
-ikarus_main (int argc, char** argv, char* boot_file)
+ikarus_main (int argc, char** argv, char* boot_file, char* heap_image)
 /* Setup  global variables  and handlers,  then load  the boot  file and
    evaluate it.  This  function is meant to be  called from "main()" and
    its return value becomes the return value of "main()".
 
    "argc" and "argv" must reference arguments on the command line of the
-   "vicare" executable,  with the command  name and the  option "--boot"
-   removed.
+   "vicare" executable,  with the command  name and the  options "--boot"
+   and "--heap-image" removed.
 
    "boot_file" must  be a string  representing the filename of  the boot
-   file to use. */
+   file to use.
+
+   "heap_image" must be  NULL or a string representing the  filename of a
+   heap image saved by  "save-heap-image"; when not NULL: the  image is
+   loaded in place of the boot file  and its entry closure is called, with
+   the  image filename  as first  command line  argument.  If the image
+   cannot be used: the boot file is loaded as usual. */
 {
   ikpcb *	pcb;
   int		repl_on_sigint	= 0;
+  void *	image		= NULL;
   if (! cpu_has_sse2()) {
     fprintf(stderr, "Vicare Scheme cannot run on your computer because\n");
     fprintf(stderr, "your CPU does not support the SSE2 instruction set.\n");
@@ -69,6 +91,10 @@ ikarus_main (int argc, char** argv, char* boot_file)
     ik_abort("limb size does not match");
   if (mp_bits_per_limb != (8*sizeof(long int)))
     ik_abort("invalid bits_per_limb=%d\n", mp_bits_per_limb);
+  /* Map the image before building the PCB, whose memory could take the
+     addresses needed by the image pages. */
+  if (heap_image)
+    image = ik_map_heap_image(heap_image);
   the_pcb = pcb = ik_make_pcb();
   { /* Set up arg_list from the  last "argv" to the first; the resulting
        list will end in COMMAND-LINE. */
@@ -79,24 +105,20 @@ ikarus_main (int argc, char** argv, char* boot_file)
       if (0 == strcmp(argv[i], "--repl-on-sigint")) {
 	repl_on_sigint = 1;
       } else {
-	char *	s = argv[i];
-	int	n = strlen(s);
-	ikptr	bv = ik_unsafe_alloc(pcb, IK_ALIGN(disp_bytevector_data+n+1)) | bytevector_tag;
-	IK_REF(bv, off_bytevector_length) = IK_FIX(n);
-	/* copy the bytes and the terminating zero */
-	memcpy((char*)(bv+off_bytevector_data), s, n+1);
-	ikptr p = iku_pair_alloc(pcb);
-	IK_CAR(p) = bv;
-	IK_CDR(p) = arg_list;
-	arg_list  = p;
+	arg_list = prepend_argument(pcb, argv[i], arg_list);
       }
     }
+    if (image)
+      arg_list = prepend_argument(pcb, heap_image, arg_list);
     pcb->argv0    = argv[0];
     pcb->arg_list = arg_list;
   }
   register_handlers(repl_on_sigint);
   register_alt_stack();
-  ik_fasl_load(pcb, boot_file);
+  if (image)
+    ik_run_heap_image(pcb, image);
+  else
+    ik_fasl_load(pcb, boot_file);
   ik_delete_pcb(pcb);
   return 0;
 }
@@ -142,6 +142,37 @@ ik_munmap (ikptr mem, ik_ulong size)
   ik_debug_message("%s: 0x%016lx .. 0x%016lx\n", __func__, (long)mem, ((long)(mem))+mapsize-1);
 #endif
 }
+ikptr
+ik_mmap_file_at (ikptr base, ik_ulong size, int fd, off_t offset)
+/* Map SIZE bytes from the file FD, starting  at OFFSET, at the memory address
+   BASE; the mapping is private: writing  to the memory does not modify the
+   file.  This function is used  to map the pages of a heap image back to
+   the addresses they were saved from.
+
+     If successful return BASE; if the memory  at BASE is not available or
+   the mapping fails: return 0.  The  returned memory is released with the
+   usual "ik_munmap()". */
+{
+  ik_ulong	npages  = IK_MINIMUM_PAGES_NUMBER_FOR_SIZE(size);
+  ik_ulong	mapsize = IK_MMAP_ALLOCATION_SIZE_FOR_PAGES(npages);
+  int		flags   = MAP_PRIVATE;
+  char *	mem;
+  assert(size == mapsize);
+#ifdef MAP_FIXED_NOREPLACE
+  /* Without this flag the address is only a hint: below we check that the
+     kernel honoured it. */
+  flags |= MAP_FIXED_NOREPLACE;
+#endif
+  mem = mmap((void*)base, mapsize, PROT_READ|PROT_WRITE|PROT_EXEC, flags, fd, offset);
+  if (MAP_FAILED == mem)
+    return 0;
+  if ((ikptr)mem != base) {
+    munmap(mem, mapsize);
+    return 0;
+  }
+  total_allocated_pages += npages;
+  return base;
+}
 
 
 /** --------------------------------------------------------------------
@@ -229,6 +260,24 @@ ik_mmap_mainheap (ik_ulong size, ikpcb* pcb)
 {
   return ik_mmap_typed(size, MAINHEAP_MT, pcb);
 }
+void
+ik_adopt_pages (ikptr base, ik_ulong size, const uint32_t * types, const uint32_t * dirt, ikpcb* pcb)
+/* Register in the segments vector and  dirty vector the memory block starting
+   at BASE  and SIZE bytes wide, which  was mapped without going through
+   "ik_mmap_typed()".  TYPES  and DIRT must  reference arrays with  a slot
+   for  every page  in the  block: the  segments vector  type and  the dirty
+   vector bits of the page.  This  function is used to register the pages of
+   a heap image. */
+{
+  uint32_t *	dirty_vec = (uint32_t *)pcb->dirty_vector;
+  ik_ulong	page_idx  = IK_PAGE_INDEX(base);
+  ik_ulong	i;
+  extend_page_vectors_maybe(base, size, pcb);
+  for (i=0; i<IK_PAGE_INDEX_RANGE(size); ++i) {
+    pcb->segment_vector[page_idx+i] = types[i];
+    dirty_vec[page_idx+i]           = dirt[i];
+  }
+}
 static void
 set_page_range_type (ikptr base, ik_ulong size, uint32_t type, ikpcb* pcb)
 /* Set to TYPE all the entries in "pcb->segment_vector" corresponding to
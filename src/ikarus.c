@@ -29,11 +29,12 @@
 int
 main (int argc, char** argv)
 {
-  char *        boot_file = NULL;
+  char *        boot_file  = NULL;
+  char *        heap_image = NULL;
   int           i, j;
-  /* Filter out the "-b" and  "--boot" options because we need them here
-     to load  the boot file.   Shift the other arguments  accordingly in
-     "argv". */
+  /* Filter out the "-b", "--boot" and "--heap-image" options because we
+     need them here to load the boot file or the heap image.  Shift the
+     other arguments accordingly in "argv". */
   for (i=1, j=1; i<argc; ++i) {
     if ((0 == strcmp(argv[i], "-b")) ||
         (0 == strcmp(argv[i], "--boot"))) {
@@ -49,6 +50,19 @@ main (int argc, char** argv)
                 argv[0], argv[i]);
         exit(2);
       }
+    } else if (0 == strcmp(argv[i], "--heap-image")) {
+      if (i+1 < argc) {
+        if (heap_image) {
+          fprintf(stderr, "*** %s error: option --heap-image used multiple times\n", argv[0]);
+          exit(2);
+        } else {
+          heap_image = argv[++i];
+        }
+      } else {
+        fprintf(stderr, "*** %s error: option --heap-image needs the image filename as argument\n",
+                argv[0]);
+        exit(2);
+      }
     } else {
       argv[j] = argv[i];
       ++j;
@@ -64,7 +78,7 @@ main (int argc, char** argv)
   }
   if (NULL == boot_file)
     boot_file = BOOTFILE;
-  return ikarus_main(j, argv, boot_file);
+  return ikarus_main(j, argv, boot_file, heap_image);
 }
 
 /* end of file */
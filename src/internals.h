@@ -540,6 +540,10 @@
 #define IK_FASL_HEADER		((sizeof(ikptr) == 4)? "#@IK01" : "#@IK02")
 #define IK_FASL_HEADER_LEN	(strlen(IK_FASL_HEADER))
 
+/* Header of compressed FASL containers, see "ikarus-fasl.c". */
+#define IK_FASL_COMPRESSED_HEADER	((sizeof(ikptr) == 4)? "#@IKZ1" : "#@IKZ2")
+#define IK_FASL_COMPRESSED_HEADER_LEN	(strlen(IK_FASL_COMPRESSED_HEADER))
+
 
 /** --------------------------------------------------------------------
  ** Type definitions.
@@ -991,6 +995,9 @@ ik_private_decl ikptr	ik_mmap_data		(unsigned long size, int gen, ikpcb*);
 ik_private_decl ikptr	ik_mmap_code		(unsigned long size, int gen, ikpcb*);
 ik_private_decl ikptr	ik_mmap_mainheap	(unsigned long size, ikpcb*);
 ik_private_decl void	ik_munmap		(ikptr, unsigned long);
+ik_private_decl ikptr	ik_mmap_file_at		(ikptr base, unsigned long size, int fd, off_t offset);
+ik_private_decl void	ik_adopt_pages		(ikptr base, unsigned long size,
+						 const uint32_t * types, const uint32_t * dirt, ikpcb*);
 ik_private_decl ikpcb * ik_make_pcb		(void);
 ik_private_decl void	ik_delete_pcb		(ikpcb*);
 ik_private_decl void	ik_free_symbol_table	(ikpcb* pcb);
@@ -998,6 +1005,9 @@ ik_private_decl void	ik_free_symbol_table	(ikpcb* pcb);
 ik_private_decl void	ik_fasl_load		(ikpcb* pcb, char* filename);
 ik_private_decl void	ik_relocate_code	(ikptr);
 
+ik_private_decl void *	ik_map_heap_image	(const char * filename);
+ik_private_decl void	ik_run_heap_image	(ikpcb* pcb, void * image);
+
 ik_private_decl ikptr	ik_exec_code		(ikpcb* pcb, ikptr code_ptr, ikptr argcount, ikptr cp);
 
 ik_private_decl ikptr	ik_asm_enter		(ikpcb* pcb, ikptr code_object_entry_point,
@@ -1999,7 +2009,7 @@ void	win_munmap(char* addr, size_t size);
 char*	win_mmap(size_t size);
 #endif
 
-int	ikarus_main (int argc, char** argv, char* boot_file);
+int	ikarus_main (int argc, char** argv, char* boot_file, char* heap_image);
 
 ikptr	ik_errno_to_code (void);
 